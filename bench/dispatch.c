@@ -0,0 +1,77 @@
+// dispatch overhead of the execution plan: a tree of no-op cases is compiled
+// once, then run through the fast path, with and without per-case timing.
+// Includes the library source to time the phases of a run separately.
+#include "../src/unittest.c"
+
+#define BENCH_SUITE_SIZE 1000
+
+static test_status_t bench_noop(void) {
+    return STATUS_SUCCESS;
+}
+
+static test_runner_t* bench_runner(int count) {
+    test_runner_t* runner = test_runner_create();
+    if (!runner) return NULL;
+    test_runner_set_capture(runner, false);
+    
+    char name[64];
+    for (int suite_index = 0; suite_index * BENCH_SUITE_SIZE < count; suite_index++) {
+        snprintf(name, sizeof(name), "suite_%d", suite_index);
+        test_suite_t* suite = test_suite_create(name);
+        for (int i = 0; i < BENCH_SUITE_SIZE && suite_index * BENCH_SUITE_SIZE + i < count; i++) {
+            snprintf(name, sizeof(name), "case_%d", i);
+            test_suite_add_test_case(suite, test_case_create(name, bench_noop));
+        }
+        test_runner_add_suite(runner, suite);
+    }
+    return runner;
+}
+
+static void bench_run(int count, bool timing) {
+    test_runner_t* runner = bench_runner(count);
+    if (!runner) return;
+    test_runner_set_timing(runner, timing);
+    
+    run_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.runner = runner;
+    run_plan_t plan;
+    
+    uint64_t start = monotonic_ns();
+    if (compile_plan(&context, &plan) != 0) {
+        fprintf(stderr, "compile failed\n");
+        free_plan(&plan);
+        test_runner_destroy(runner);
+        return;
+    }
+    uint64_t compiled = monotonic_ns();
+    
+    size_t next = 0;
+    while (next < plan.count) {
+        next = dispatch_plan(&plan, next, plan.count, timing);
+    }
+    uint64_t dispatched = monotonic_ns();
+    
+    commit_plan(&context, &plan, 0, plan.count, NULL);
+    uint64_t committed = monotonic_ns();
+    
+    double per_case = 1.0 / (double)count;
+    printf("%d cases, timing %-3s  compile %6.1f ns  dispatch %6.2f ns  commit %6.1f ns  (per case)\n",
+           count, timing ? "on" : "off",
+           (double)(compiled - start) * per_case,
+           (double)(dispatched - compiled) * per_case,
+           (double)(committed - dispatched) * per_case);
+    
+    free_plan(&plan);
+    free(context.failed);
+    test_runner_destroy(runner);
+}
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) count = 1000000;
+    
+    bench_run(count, false);
+    bench_run(count, true);
+    return 0;
+}
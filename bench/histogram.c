@@ -0,0 +1,126 @@
+// status histogram kernels over one status column, the size of a large fuzz
+// or parameterized case by default, then the whole stats pass over a tree of
+// such cases stored in a runner's result store. Every kernel must agree with
+// the scalar one.
+// Includes the library source to call the kernels directly.
+#include "../src/unittest.c"
+
+#define BENCH_REPEATS 5
+#define BENCH_CASES 1000
+
+static bool bench_kernel(const char* name, count_statuses_func_t func, const uint8_t* statuses,
+                         size_t count, const size_t* expected) {
+    size_t counts[STATUS_KIND_COUNT];
+    uint64_t best = UINT64_MAX;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        memset(counts, 0, sizeof(counts));
+        uint64_t start = monotonic_ns();
+        func(statuses, count, counts);
+        uint64_t elapsed = monotonic_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    
+    bool same = memcmp(counts, expected, sizeof(counts)) == 0;
+    printf("%-8s %8.3f ms  %6.3f ns/result  %6.2f GB/s%s\n", name, (double)best / 1e6,
+           (double)best / (double)count,
+           (double)count / (double)(best ? best : 1),
+           same ? "" : "  MISMATCH");
+    return same;
+}
+
+// the stats pass of print_test_results, over a suite whose BENCH_CASES
+// cases are stored back to back as they would be after a run
+static bool bench_tree(const uint8_t* statuses, size_t count, const size_t* expected) {
+    test_runner_t* runner = test_runner_create();
+    test_suite_t* suite = test_suite_create("bench");
+    if (!runner || !suite) {
+        test_suite_destroy(suite);
+        test_runner_destroy(runner);
+        return false;
+    }
+    test_runner_add_suite(runner, suite);
+    
+    size_t per_case = count / BENCH_CASES;
+    for (int i = 0; i < BENCH_CASES; i++) {
+        size_t first = i * per_case;
+        size_t length = i + 1 < BENCH_CASES ? per_case : count - first;
+        test_case_t* test_case = test_case_create("case", NULL);
+        if (!test_case || reserve_results(test_case, (int)length) != 0) {
+            test_case_destroy(test_case);
+            test_runner_destroy(runner);
+            return false;
+        }
+        for (size_t j = 0; j < length; j++) {
+            test_case->results[j] = (test_status_t)statuses[first + j];
+        }
+        test_case->result_count = (int)length;
+        test_suite_add_test_case(suite, test_case);
+    }
+    
+    const result_store_t* store = sync_result_store(runner);
+    uint64_t best = UINT64_MAX;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        uint64_t start = monotonic_ns();
+        calculate_suite_stats(store, suite);
+        uint64_t elapsed = monotonic_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    
+    const test_stats_t* stats = &suite->stats;
+    bool same = (size_t)stats->success_count == expected[STATUS_SUCCESS] &&
+                (size_t)stats->unexpected_output_count == expected[STATUS_UNEXPECTED_OUTPUT] &&
+                (size_t)stats->expected_build_error_count == expected[STATUS_EXPECTED_BUILD_ERROR] &&
+                (size_t)stats->build_error_count == expected[STATUS_BUILD_ERROR] &&
+                (size_t)stats->expected_runtime_error_count == expected[STATUS_EXPECTED_RUNTIME_ERROR] &&
+                (size_t)stats->runtime_error_count == expected[STATUS_RUNTIME_ERROR];
+    printf("%-8s %8.3f ms  %6.3f ns/result%s\n", "stats", (double)best / 1e6,
+           (double)best / (double)count, same ? "" : "  MISMATCH");
+    test_runner_destroy(runner);
+    return same;
+}
+
+int main(int argc, char* argv[]) {
+    long long requested = argc > 1 ? atoll(argv[1]) : 100000000LL;
+    size_t count = requested > 0 ? (size_t)requested : 100000000;
+    
+    uint8_t* statuses = malloc(count);
+    if (!statuses) {
+        fprintf(stderr, "allocation failed\n");
+        return 1;
+    }
+    
+    // mostly passing, a spread of every other kind and a few invalid values
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < count; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        unsigned roll = (unsigned)(state % 100);
+        statuses[i] = (uint8_t)(roll < 90 ? STATUS_SUCCESS : roll < 99 ? roll % STATUS_KIND_COUNT :
+                                STATUS_INVALID);
+    }
+    
+    size_t expected[STATUS_KIND_COUNT] = { 0 };
+    count_statuses_scalar(statuses, count, expected);
+    printf("%zu results, by status:", count);
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        printf(" %zu", expected[k]);
+    }
+    printf("\n");
+    
+    bool ok = bench_kernel("scalar", count_statuses_scalar, statuses, count, expected);
+#ifdef STATUS_HISTOGRAM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        ok &= bench_kernel("sse2", count_statuses_sse2, statuses, count, expected);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        ok &= bench_kernel("avx2", count_statuses_avx2, statuses, count, expected);
+    }
+#endif
+    ok &= bench_kernel("selected", count_statuses, statuses, count, expected);
+    if (count >= BENCH_CASES) ok &= bench_tree(statuses, count, expected);
+    
+    free(statuses);
+    return ok ? 0 : 1;
+}
@@ -1,22 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "unittest.h"
 
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <elf.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+// glibc only declares it with _GNU_SOURCE
+int memfd_create(const char* name, unsigned int flags);
+#endif
+
+// SIMD status histograms, chosen at runtime, see count_statuses
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STATUS_HISTOGRAM_X86 1
+#include <immintrin.h>
+#endif
+
 #define INITIAL_RESULT_CAPACITY 8
+#define REPORT_LIMIT 512
+#define PATH_HASH_ROOT 0xCBF29CE484222325ULL
+#define PATH_HASH_PRIME 0x100000001B3ULL
+#define DEFAULT_PROPERTY_ITERATIONS 1000
+#define PROPERTY_CHUNK 64
+#define PROPERTY_MAX_CHOICES 65536
+#define PROPERTY_MAX_SHRINK_RUNS 10000
+#define DEFAULT_STRESS_ITERATIONS 100000
+#define DEFAULT_ASYNC_TIMEOUT_MS 5000
+#define ASYNC_MAX_EVENTS 64
+#define CAPTURE_LIMIT 4096
+#define OUTPUT_LINES 10
+#define DEFAULT_RUN_LENGTH 8
 
-static const char* get_status_color(test_status_t status) {
-    switch (status) {
-        case STATUS_SUCCESS:
-            return ANSI_GREEN;
-        case STATUS_UNEXPECTED_OUTPUT:
-            return ANSI_YELLOW;
-        case STATUS_EXPECTED_BUILD_ERROR:
-        case STATUS_EXPECTED_RUNTIME_ERROR:
-            return ANSI_GRAY;
-        case STATUS_BUILD_ERROR:
-        case STATUS_RUNTIME_ERROR:
-            return ANSI_RED;
-        default:
-            return ANSI_RESET;
+#define STATUS_KIND_COUNT 6
+#define STATUS_INVALID 7    // anything out of range, shown as '?' and counted nowhere
+
+// escapes and result glyphs for one kind of output, indexed by status_index;
+// picked once per run so printing never checks whether it may use color
+typedef struct {
+    const char* reset;
+    const char* green;
+    const char* yellow;
+    const char* red;
+    const char* gray;
+    const char* colors[8];
+    const char* glyphs[8];  // "K " and so on
+} palette_t;
+
+static const palette_t color_palette = {
+    ANSI_RESET, ANSI_GREEN, ANSI_YELLOW, ANSI_RED, ANSI_GRAY,
+    { ANSI_GREEN, ANSI_YELLOW, ANSI_GRAY, ANSI_RED, ANSI_GRAY, ANSI_RED, ANSI_RESET, ANSI_RESET },
+    {
+        ANSI_GREEN "K" ANSI_RESET " ", ANSI_YELLOW "K" ANSI_RESET " ",
+        ANSI_GRAY "B" ANSI_RESET " ", ANSI_RED "B" ANSI_RESET " ",
+        ANSI_GRAY "R" ANSI_RESET " ", ANSI_RED "R" ANSI_RESET " ",
+        ANSI_RESET "?" ANSI_RESET " ", ANSI_RESET "?" ANSI_RESET " "
     }
+};
+
+static const palette_t plain_palette = {
+    "", "", "", "", "",
+    { "", "", "", "", "", "", "", "" },
+    { "K ", "K ", "B ", "B ", "R ", "R ", "? ", "? " }
+};
+
+static const palette_t* palette = &color_palette;
+static int run_length = 0;  // shortest run of equal results printed as one, 0 for none
+
+static unsigned status_index(test_status_t status) {
+    return (unsigned)status <= STATUS_RUNTIME_ERROR ? (unsigned)status : STATUS_INVALID;
+}
+
+static const char* get_status_color(test_status_t status) {
+    return palette->colors[status_index(status)];
+}
+
+// color unless NO_COLOR is set, the terminal is dumb or stdout is not one
+static bool detect_color(void) {
+    const char* no_color = getenv("NO_COLOR");
+    if (no_color && *no_color) return false;
+    
+    const char* term = getenv("TERM");
+    if (!term || strcmp(term, "dumb") == 0) return false;
+    return isatty(STDOUT_FILENO);
+}
+
+// how results are printed for the current run
+static void select_rendering(const test_runner_t* runner) {
+    palette = runner->color ? &color_palette : &plain_palette;
+    run_length = runner->run_length;
 }
 
 static char get_status_char(test_status_t status) {
@@ -35,12 +123,522 @@ static char get_status_char(test_status_t status) {
     }
 }
 
+static bool status_is_failure(test_status_t status) {
+    return status == STATUS_UNEXPECTED_OUTPUT ||
+           status == STATUS_BUILD_ERROR ||
+           status == STATUS_RUNTIME_ERROR;
+}
+
+static bool case_failed(const test_case_t* test_case) {
+    for (int i = 0; i < test_case->result_count; i++) {
+        if (status_is_failure(test_case->results[i])) return true;
+    }
+    return false;
+}
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t hash_string(const char* str) {
+    uint64_t hash = PATH_HASH_ROOT; // fnv-1a
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= PATH_HASH_PRIME;
+    }
+    return hash;
+}
+
+// extending the hash of "A" with "B" yields the hash of "A/B"
+static uint64_t path_hash_extend(uint64_t hash, const char* name) {
+    if (hash != PATH_HASH_ROOT) {
+        hash ^= '/';
+        hash *= PATH_HASH_PRIME;
+    }
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= PATH_HASH_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t path_hash_extend_n(uint64_t hash, const char* name, size_t length) {
+    if (hash != PATH_HASH_ROOT) {
+        hash ^= '/';
+        hash *= PATH_HASH_PRIME;
+    }
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= PATH_HASH_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// open addressing on path hashes, empty slots have a NULL value
+typedef struct {
+    uint64_t* keys;
+    void** values;
+    size_t mask;
+    size_t count;
+} hash_map_t;
+
+static int hash_map_init(hash_map_t* map, size_t expected) {
+    size_t capacity = 16;
+    while (capacity < expected * 2) capacity *= 2;
+    
+    map->keys = malloc(capacity * sizeof(uint64_t));
+    map->values = calloc(capacity, sizeof(void*));
+    map->mask = capacity - 1;
+    map->count = 0;
+    if (!map->keys || !map->values) {
+        free(map->keys);
+        free(map->values);
+        map->keys = NULL;
+        map->values = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void hash_map_free(hash_map_t* map) {
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+}
+
+static void* hash_map_get(const hash_map_t* map, uint64_t key) {
+    if (!map->values) return NULL;
+    
+    for (size_t i = key & map->mask; map->values[i]; i = (i + 1) & map->mask) {
+        if (map->keys[i] == key) return map->values[i];
+    }
+    return NULL;
+}
+
+static int hash_map_put(hash_map_t* map, uint64_t key, void* value) {
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        hash_map_t grown;
+        if (hash_map_init(&grown, map->mask + 1) != 0) return -1;
+        for (size_t i = 0; i <= map->mask; i++) {
+            if (map->values[i]) hash_map_put(&grown, map->keys[i], map->values[i]);
+        }
+        hash_map_free(map);
+        *map = grown;
+    }
+    
+    size_t i = key & map->mask;
+    while (map->values[i] && map->keys[i] != key) {
+        i = (i + 1) & map->mask;
+    }
+    if (!map->values[i]) map->count++;
+    map->keys[i] = key;
+    map->values[i] = value;
+    return 0;
+}
+
+// bump allocator for data that is only ever freed all at once
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t used;
+    size_t size;
+    char data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t* head;
+} arena_t;
+
+#define ARENA_CHUNK_SIZE 1024
+
+static void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    arena_chunk_t* chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+        if (!chunk) return NULL;
+        chunk->next = arena->head;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena->head = chunk;
+    }
+    
+    void* memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+static char* arena_strndup(arena_t* arena, const char* string, size_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void arena_free(arena_t* arena) {
+    arena_chunk_t* chunk = arena->head;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
+
+// names are interned process-wide since cases exist before they are added
+// to a runner; suites and cases share the copies, which are never freed
+typedef struct {
+    const char** slots;
+    size_t mask;
+    size_t count;
+    arena_t arena;
+} intern_table_t;
+
+static intern_table_t interned_names;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int intern_grow(intern_table_t* table) {
+    size_t capacity = table->slots ? (table->mask + 1) * 2 : 1024;
+    const char** slots = calloc(capacity, sizeof(const char*));
+    if (!slots) return -1;
+    
+    for (size_t i = 0; table->slots && i <= table->mask; i++) {
+        if (!table->slots[i]) continue;
+        size_t j = hash_string(table->slots[i]) & (capacity - 1);
+        while (slots[j]) j = (j + 1) & (capacity - 1);
+        slots[j] = table->slots[i];
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->mask = capacity - 1;
+    return 0;
+}
+
+static const char* intern_name_n(const char* name, size_t length) {
+    uint64_t hash = path_hash_extend_n(PATH_HASH_ROOT, name, length);
+    const char* interned = NULL;
+    
+    pthread_mutex_lock(&intern_lock);
+    intern_table_t* table = &interned_names;
+    if ((table->count + 1) * 2 <= table->mask + 1 || intern_grow(table) == 0) {
+        size_t i = hash & table->mask;
+        while (table->slots[i] && (strncmp(table->slots[i], name, length) != 0 ||
+                                   table->slots[i][length] != '\0')) {
+            i = (i + 1) & table->mask;
+        }
+        interned = table->slots[i];
+        if (!interned) {
+            interned = arena_strndup(&table->arena, name, length);
+            if (interned) {
+                table->slots[i] = interned;
+                table->count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return interned;
+}
+
+static const char* intern_name(const char* name) {
+    return name ? intern_name_n(name, strlen(name)) : NULL;
+}
+
+// starts up to count - 1 threads running func, returns how many started
+static int start_threads(pthread_t* threads, int count, void* (*func)(void*), void* arg) {
+    int started = 0;
+    while (started < count - 1 && pthread_create(&threads[started], NULL, func, arg) == 0) {
+        started++;
+    }
+    return started;
+}
+
+static void join_threads(pthread_t* threads, int started) {
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// runs func on count threads, the calling thread being one of them; returns
+// how many ran, fewer than count when threads could not be created
+static int run_threads(int count, void* (*func)(void*), void* arg) {
+    pthread_t* threads = count > 1 ? malloc((count - 1) * sizeof(pthread_t)) : NULL;
+    int started = threads ? start_threads(threads, count, func, arg) : 0;
+    
+    func(arg);
+    join_threads(threads, started);
+    free(threads);
+    return started + 1;
+}
+
+// tree mutation, i.e. registration, module loading and log merging, takes
+// this lock so suites can be registered from several threads
+static pthread_mutex_t registration_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// bumped on every mutation so path indexes know when to rebuild
+static uint64_t tree_generation = 1;
+
+// path hash of "A/B/case" to its node, rebuilt when the tree has changed;
+// entries keep the name and parent hash of their node, so lookups compare
+// names instead of trusting the hash
+typedef struct {
+    void* node;         // NULL once two different paths share the hash
+    uint64_t parent;    // path hash of the parent suite, PATH_HASH_ROOT at the top
+    const char* name;   // interned
+} path_entry_t;
+
+struct path_index {
+    hash_map_t suites;
+    hash_map_t cases;
+    arena_t entries;
+    uint64_t generation;
+};
+
+static bool path_entry_named(const path_entry_t* entry, uint64_t parent, const char* name, size_t length) {
+    return entry->parent == parent && strlen(entry->name) == length && memcmp(entry->name, name, length) == 0;
+}
+
+// the same path registered twice keeps the last node; a different path with
+// the same hash leaves neither reachable and is reported
+static int path_index_put(struct path_index* index, hash_map_t* map, uint64_t hash, void* node, uint64_t parent,
+                          const char* name) {
+    path_entry_t* entry = hash_map_get(map, hash);
+    if (entry) {
+        if (path_entry_named(entry, parent, name, strlen(name))) {
+            if (entry->node) entry->node = node;
+        } else if (entry->node) {
+            fprintf(stderr, "Warning: %s and %s share a path hash, neither can be looked up by path\n",
+                    entry->name, name);
+            entry->node = NULL;
+        }
+        return 0;
+    }
+    
+    entry = arena_alloc(&index->entries, sizeof(path_entry_t));
+    if (!entry) return -1;
+    entry->node = node;
+    entry->parent = parent;
+    entry->name = name;
+    return hash_map_put(map, hash, entry);
+}
+
+// the node with that hash, provided no suite above it shares its hash either
+static void* path_index_get(const struct path_index* index, const hash_map_t* map, uint64_t hash) {
+    const path_entry_t* entry = hash_map_get(map, hash);
+    void* node = entry ? entry->node : NULL;
+    while (entry && entry->node) {
+        if (entry->parent == PATH_HASH_ROOT) return node;
+        entry = hash_map_get(&index->suites, entry->parent);
+    }
+    return NULL;
+}
+
+// the node at path, compared name by name up to the top level
+static void* path_index_find(const struct path_index* index, const hash_map_t* map, const char* path) {
+    size_t length = strlen(path);
+    const path_entry_t* entry = hash_map_get(map, path_hash_extend_n(PATH_HASH_ROOT, path, length));
+    void* node = entry ? entry->node : NULL;
+    while (entry && entry->node) {
+        size_t name_length = strlen(entry->name);
+        if (name_length > length || memcmp(path + length - name_length, entry->name, name_length) != 0) break;
+        
+        length -= name_length;
+        if (entry->parent == PATH_HASH_ROOT) return length == 0 ? node : NULL;
+        if (length == 0 || path[length - 1] != '/') break;
+        length--;
+        entry = hash_map_get(&index->suites, entry->parent);
+    }
+    return NULL;
+}
+
+static int map_suites(struct path_index* index, test_suite_t* suite, uint64_t parent_hash) {
+    uint64_t suite_hash = path_hash_extend(parent_hash, suite->name);
+    if (path_index_put(index, &index->suites, suite_hash, suite, parent_hash, suite->name) != 0) return -1;
+    for (test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        uint64_t case_hash = path_hash_extend(suite_hash, current_case->name);
+        if (path_index_put(index, &index->cases, case_hash, current_case, suite_hash, current_case->name) != 0) {
+            return -1;
+        }
+    }
+    for (test_suite_t* child = suite->child_suites; child; child = child->next) {
+        if (map_suites(index, child, suite_hash) != 0) return -1;
+    }
+    return 0;
+}
+
+static void free_path_index(test_runner_t* runner) {
+    if (!runner->index) return;
+    
+    hash_map_free(&runner->index->suites);
+    hash_map_free(&runner->index->cases);
+    arena_free(&runner->index->entries);
+    free(runner->index);
+    runner->index = NULL;
+}
+
+// caller holds registration_lock
+static struct path_index* update_path_index(test_runner_t* runner) {
+    struct path_index* index = runner->index;
+    if (index && index->generation == tree_generation) return index;
+    
+    free_path_index(runner);
+    index = malloc(sizeof(struct path_index));
+    if (!index) return NULL;
+    index->entries.head = NULL;
+    if (hash_map_init(&index->suites, 64) != 0 || hash_map_init(&index->cases, 1024) != 0) {
+        hash_map_free(&index->suites);
+        free(index);
+        return NULL;
+    }
+    
+    int status = 0;
+    for (test_suite_t* suite = runner->root_suite; suite && status == 0; suite = suite->next) {
+        status = map_suites(index, suite, PATH_HASH_ROOT);
+    }
+    index->generation = tree_generation;
+    runner->index = index;
+    if (status != 0) {
+        free_path_index(runner);
+        return NULL;
+    }
+    return index;
+}
+
+test_suite_t* test_runner_find_suite(test_runner_t* runner, const char* path) {
+    if (!runner || !path) return NULL;
+    
+    pthread_mutex_lock(&registration_lock);
+    struct path_index* index = update_path_index(runner);
+    test_suite_t* suite = index ? path_index_find(index, &index->suites, path) : NULL;
+    pthread_mutex_unlock(&registration_lock);
+    return suite;
+}
+
+test_case_t* test_runner_find_case(test_runner_t* runner, const char* path) {
+    if (!runner || !path) return NULL;
+    
+    pthread_mutex_lock(&registration_lock);
+    struct path_index* index = update_path_index(runner);
+    test_case_t* test_case = index ? path_index_find(index, &index->cases, path) : NULL;
+    pthread_mutex_unlock(&registration_lock);
+    return test_case;
+}
+
+static void free_result_store(test_runner_t* runner);
+
 test_runner_t* test_runner_create(void) {
     test_runner_t* runner = malloc(sizeof(test_runner_t));
     if (!runner) return NULL;
     
     runner->root_suite = NULL;
+    runner->last_suite = NULL;
     memset(&runner->global_stats, 0, sizeof(test_stats_t));
+    runner->jobs = 1;
+    runner->retries = 0;
+    runner->verbose = false;
+    runner->color = detect_color();
+    runner->run_length = DEFAULT_RUN_LENGTH;
+    runner->max_depth = 0;
+    runner->failures_only = false;
+    runner->collapse = false;
+    runner->capture = true;
+    runner->timing = true;
+    runner->shard_index = 0;
+    runner->shard_count = 1;
+    runner->filter = NULL;
+    runner->index = NULL;
+    runner->store = NULL;
+    runner->cache_path = NULL;
+    runner->cache = NULL;
+    runner->log_path = NULL;
+    runner->tap_path = NULL;
+    runner->modules = NULL;
+    runner->module_count = 0;
+    
+    const char* jobs = getenv("UNITTEST_JOBS");
+    if (jobs && atoi(jobs) > 0) {
+        runner->jobs = atoi(jobs);
+    }
+    
+    const char* retries = getenv("UNITTEST_RETRIES");
+    if (retries && atoi(retries) > 0) {
+        runner->retries = atoi(retries);
+    }
+    
+    const char* verbose = getenv("UNITTEST_VERBOSE");
+    if (verbose && atoi(verbose) > 0) {
+        runner->verbose = true;
+    }
+    
+    const char* color = getenv("UNITTEST_COLOR");
+    if (color && *color) {
+        runner->color = atoi(color) > 0;
+    }
+    
+    const char* runs = getenv("UNITTEST_RUN_LENGTH");
+    if (runs && *runs) {
+        test_runner_set_run_length(runner, atoi(runs));
+    }
+    
+    const char* depth = getenv("UNITTEST_DEPTH");
+    if (depth && atoi(depth) > 0) {
+        runner->max_depth = atoi(depth);
+    }
+    
+    const char* failures_only = getenv("UNITTEST_FAILURES_ONLY");
+    if (failures_only && atoi(failures_only) > 0) {
+        runner->failures_only = true;
+    }
+    
+    const char* collapse = getenv("UNITTEST_COLLAPSE");
+    if (collapse && atoi(collapse) > 0) {
+        runner->collapse = true;
+    }
+    
+    const char* capture = getenv("UNITTEST_CAPTURE");
+    if (capture && *capture) {
+        runner->capture = atoi(capture) > 0;
+    }
+    
+    const char* timing = getenv("UNITTEST_TIMING");
+    if (timing && *timing) {
+        runner->timing = atoi(timing) > 0;
+    }
+    
+    // e.g. UNITTEST_SHARD=2/8 runs the third of eight shards
+    const char* shard = getenv("UNITTEST_SHARD");
+    if (shard && *shard) {
+        int index = -1;
+        int count = 0;
+        if (sscanf(shard, "%d/%d", &index, &count) != 2 ||
+            test_runner_set_shard(runner, index, count) != 0) {
+            fprintf(stderr, "Warning: Invalid shard %s\n", shard);
+        }
+    }
+    
+    // e.g. UNITTEST_TAGS="smoke | (io & !slow)"
+    const char* tags = getenv("UNITTEST_TAGS");
+    if (tags && *tags && test_runner_set_filter(runner, tags) != 0) {
+        fprintf(stderr, "Warning: Invalid tag filter %s\n", tags);
+    }
+    
+    // UNITTEST_SEED reproduces a previous run
+    const char* seed = getenv("UNITTEST_SEED");
+    if (seed && *seed) {
+        runner->seed = strtoull(seed, NULL, 0);
+    } else {
+        runner->seed = splitmix64((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32) ^ (uint64_t)clock());
+    }
     return runner;
 }
 
@@ -50,6 +648,18 @@ void test_runner_destroy(test_runner_t* runner) {
     if (runner->root_suite) {
         test_suite_destroy_siblings(runner->root_suite);
     }
+    free(runner->cache_path);
+    free(runner->log_path);
+    free(runner->tap_path);
+    test_runner_set_filter(runner, NULL);
+    free_path_index(runner);
+    free_result_store(runner);
+    
+    // test code may live in the modules, so they go last
+    for (int i = 0; i < runner->module_count; i++) {
+        dlclose(runner->modules[i]);
+    }
+    free(runner->modules);
     free(runner);
 }
 
@@ -57,7 +667,7 @@ test_suite_t* test_suite_create(const char* name) {
     test_suite_t* suite = malloc(sizeof(test_suite_t));
     if (!suite) return NULL;
     
-    suite->name = strdup(name);
+    suite->name = intern_name(name);
     if (!suite->name) {
         free(suite);
         return NULL;
@@ -66,6 +676,9 @@ test_suite_t* test_suite_create(const char* name) {
     suite->test_cases = NULL;
     suite->child_suites = NULL;
     suite->next = NULL;
+    suite->last_test_case = NULL;
+    suite->last_child = NULL;
+    suite->tags = 0;
     memset(&suite->stats, 0, sizeof(test_stats_t));
     return suite;
 }
@@ -81,7 +694,6 @@ void test_suite_destroy(test_suite_t* suite) {
         test_suite_destroy_siblings(suite->child_suites);
     }
     
-    free(suite->name);
     free(suite);
 }
 
@@ -97,276 +709,5802 @@ void test_suite_destroy_siblings(test_suite_t* suite) {
 void test_suite_add_child(test_suite_t* parent, test_suite_t* child) {
     if (!parent || !child) return;
     
+    pthread_mutex_lock(&registration_lock);
     if (!parent->child_suites) {
         parent->child_suites = child;
     } else {
-        test_suite_t* current = parent->child_suites;
+        // start from the tail, the walk only covers lists linked by hand
+        test_suite_t* current = parent->last_child ? parent->last_child : parent->child_suites;
         while (current->next) {
             current = current->next;
         }
         current->next = child;
     }
+    parent->last_child = child;
+    tree_generation++;
+    pthread_mutex_unlock(&registration_lock);
 }
 
 void test_suite_add_test_case(test_suite_t* suite, test_case_t* test_case) {
     if (!suite || !test_case) return;
     
+    pthread_mutex_lock(&registration_lock);
     if (!suite->test_cases) {
         suite->test_cases = test_case;
     } else {
-        test_case_t* current = suite->test_cases;
+        test_case_t* current = suite->last_test_case ? suite->last_test_case : suite->test_cases;
         while (current->next) {
             current = current->next;
         }
         current->next = test_case;
     }
+    suite->last_test_case = test_case;
+    tree_generation++;
+    pthread_mutex_unlock(&registration_lock);
 }
 
 test_case_t* test_case_create(const char* name, test_func_t test_func) {
     test_case_t* test_case = malloc(sizeof(test_case_t));
     if (!test_case) return NULL;
     
-    test_case->name = strdup(name);
+    test_case->name = intern_name(name);
     if (!test_case->name) {
         free(test_case);
         return NULL;
     }
     
     test_case->test_func = test_func;
+    test_case->kind = TEST_KIND_SIMPLE;
     test_case->results = NULL;
     test_case->result_count = 0;
     test_case->result_capacity = 0;
     test_case->next = NULL;
+    test_case->param_func = NULL;
+    test_case->param_name = NULL;
+    test_case->params = NULL;
+    test_case->param_size = 0;
+    test_case->param_count = 0;
+    test_case->property_func = NULL;
+    test_case->property_iterations = 0;
+    test_case->fuzz_func = NULL;
+    test_case->fuzz_corpus = NULL;
+    test_case->stress_func = NULL;
+    test_case->stress_threads = 0;
+    test_case->stress_iterations = 0;
+    test_case->stress_duration_ns = 0;
+    test_case->async_func = NULL;
+    test_case->async_timeout_ns = 0;
+    test_case->version = 0;
+    test_case->duration_ns = 0;
+    test_case->report = NULL;
+    test_case->attempts = 0;
+    test_case->run_count = 0;
+    test_case->flaky_count = 0;
+    test_case->result_lock = 0;
+    test_case->diagnostics = NULL;
+    test_case->tags = 0;
+    test_case->filtered = false;
+    test_case->run_index = 0;
+    test_case->store_id = 0;
+    test_case->store_offset = 0;
+    test_case->store_count = 0;
     return test_case;
 }
 
-void test_case_destroy(test_case_t* test_case) {
+test_case_t* test_case_create_param(const char* name, test_param_func_t param_func,
+                                    const void* params, size_t param_size, int param_count) {
+    if (!param_func || param_count < 0 || (param_count > 0 && (!params || param_size == 0))) {
+        return NULL;
+    }
+    
+    test_case_t* test_case = test_case_create(name, NULL);
+    if (!test_case) return NULL;
+    
+    // one result slot per row, reserved up front so the run never reallocs
+    if (param_count > 0) {
+        test_case->results = malloc(param_count * sizeof(test_status_t));
+        if (!test_case->results) {
+            test_case_destroy(test_case);
+            return NULL;
+        }
+        test_case->result_capacity = param_count;
+    }
+    
+    test_case->kind = TEST_KIND_PARAM;
+    test_case->param_func = param_func;
+    test_case->params = params;
+    test_case->param_size = param_size;
+    test_case->param_count = param_count;
+    return test_case;
+}
+
+void test_case_set_param_name(test_case_t* test_case, test_param_name_func_t param_name) {
     if (!test_case) return;
-        
-    free(test_case->name);
-    free(test_case->results);
-    free(test_case);
+    test_case->param_name = param_name;
 }
 
-void test_case_destroy_siblings(test_case_t* test_case) {
-    while (test_case) {
-        test_case_t* next = test_case->next;
-        test_case->next = NULL; 
-        test_case_destroy(test_case);
-        test_case = next;
+const void* test_case_param_row(const test_case_t* test_case, int index) {
+    if (!test_case || index < 0 || index >= test_case->param_count) return NULL;
+    return (const char*)test_case->params + (size_t)index * test_case->param_size;
+}
+
+// row names only exist while a row is being printed
+static void format_param_row_name(const test_case_t* test_case, int index, char* buffer, size_t size) {
+    if (test_case->param_name) {
+        test_case->param_name(test_case_param_row(test_case, index), index, buffer, size);
+    } else {
+        snprintf(buffer, size, "%s[%d]", test_case->name, index);
     }
 }
 
-int test_case_add_result(test_case_t* test_case, test_status_t status) {
-    if (!test_case) return -1;
+test_case_t* test_case_create_property(const char* name, test_property_func_t property_func,
+                                       int iterations) {
+    if (!property_func || iterations < 0) return NULL;
     
-    // array resize
-    if (test_case->result_count >= test_case->result_capacity) {
-        int new_capacity = test_case->result_capacity == 0 ? 
-                          INITIAL_RESULT_CAPACITY : 
-                          test_case->result_capacity * 2;
-        
-        test_status_t* new_results = realloc(test_case->results, 
-                                           new_capacity * sizeof(test_status_t));
-        if (!new_results) {
-            return -1;  // realloc error
-        }
-        
-        test_case->results = new_results;
-        test_case->result_capacity = new_capacity;
+    test_case_t* test_case = test_case_create(name, NULL);
+    if (!test_case) return NULL;
+    
+    test_case->kind = TEST_KIND_PROPERTY;
+    test_case->property_func = property_func;
+    test_case->property_iterations = iterations > 0 ? iterations : DEFAULT_PROPERTY_ITERATIONS;
+    return test_case;
+}
+
+// generator state: every draw is recorded as a choice so that a failing
+// input can be replayed and shrunk without knowing what the property built
+struct test_gen {
+    uint64_t state[4];
+    const uint64_t* replay;
+    size_t replay_count;
+    size_t cursor;
+    uint64_t* choices;
+    size_t choice_count;
+    size_t choice_capacity;
+    char* report;
+    size_t report_len;
+};
+
+static uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256**
+static uint64_t gen_next(test_gen_t* gen) {
+    uint64_t* s = gen->state;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+static void gen_seed(test_gen_t* gen, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed = splitmix64(seed);
+        gen->state[i] = seed;
+    }
+}
+
+static void gen_reset(test_gen_t* gen, const uint64_t* replay, size_t replay_count) {
+    gen->replay = replay;
+    gen->replay_count = replay_count;
+    gen->cursor = 0;
+    gen->choice_count = 0;
+}
+
+// returns a value in [0, bound]; smaller choices always mean simpler inputs
+static uint64_t gen_draw(test_gen_t* gen, uint64_t bound) {
+    uint64_t value;
+    if (gen->replay) {
+        value = gen->cursor < gen->replay_count ? gen->replay[gen->cursor] : 0;
+        gen->cursor++;
+        if (value > bound) value = bound;
+    } else {
+        value = gen_next(gen);
+        if (bound != UINT64_MAX) value %= bound + 1;
     }
     
-    test_case->results[test_case->result_count] = status;
-    test_case->result_count++;
-    return 0;
+    if (gen->choice_count < PROPERTY_MAX_CHOICES) {
+        if (gen->choice_count >= gen->choice_capacity) {
+            size_t new_capacity = gen->choice_capacity == 0 ? 64 : gen->choice_capacity * 2;
+            uint64_t* new_choices = realloc(gen->choices, new_capacity * sizeof(uint64_t));
+            if (!new_choices) return value;
+            gen->choices = new_choices;
+            gen->choice_capacity = new_capacity;
+        }
+        gen->choices[gen->choice_count++] = value;
+    }
+    return value;
 }
 
-int test_case_add_results_va(test_case_t* test_case, int count, ...) {
-    if (!test_case || count <= 0) return -1;
+// only the final replay of a counterexample describes its values
+static void gen_describe(test_gen_t* gen, const char* format, ...) {
+    if (!gen->report || gen->report_len >= REPORT_LIMIT - 1) return;
     
     va_list args;
-    va_start(args, count);
+    va_start(args, format);
+    int written = vsnprintf(gen->report + gen->report_len, 
+                            REPORT_LIMIT - gen->report_len, format, args);
+    va_end(args);
     
-    for (int i = 0; i < count; i++) {
-        test_status_t status = va_arg(args, test_status_t);
-        if (test_case_add_result(test_case, status) != 0) {
-            va_end(args);
-            return -1;  // add result failed
+    if (written > 0) {
+        gen->report_len += written;
+        if (gen->report_len >= REPORT_LIMIT - 1) {
+            gen->report_len = REPORT_LIMIT - 1;
+            memcpy(gen->report + REPORT_LIMIT - 4, "...", 4);
         }
     }
-    
-    va_end(args);
-    return 0;
 }
 
-void test_runner_add_suite(test_runner_t* runner, test_suite_t* suite) {
-    if (!runner || !suite) return;
+// maps a choice onto [min, max] so that choice 0 is the value closest to zero
+static int64_t gen_int_from_choice(uint64_t choice, int64_t min, int64_t max) {
+    if (min >= 0) return (int64_t)((uint64_t)min + choice);
+    if (max <= 0) return (int64_t)((uint64_t)max - choice);
     
-    if (!runner->root_suite) {
-        runner->root_suite = suite;
-    } else {
-        test_suite_t* current = runner->root_suite;
-        while (current->next) {
-            current = current->next;
-        }
-        current->next = suite;
+    // alternate 0, -1, 1, -2, 2, ... while both sides have room
+    uint64_t negative = (uint64_t)0 - (uint64_t)min;
+    uint64_t positive = (uint64_t)max;
+    uint64_t shared = negative < positive ? negative : positive;
+    if (choice < 2 * shared + 1) {
+        uint64_t magnitude = (choice + 1) / 2;
+        if (choice & 1) return -(int64_t)(magnitude - 1) - 1;
+        return (int64_t)magnitude;
     }
+    
+    if (positive > negative) return (int64_t)(choice - negative);
+    return -(int64_t)(choice - positive - 1) - 1;
 }
 
-static void calculate_suite_stats(test_suite_t* suite) {
-    if (!suite) return;
+int64_t test_gen_int(test_gen_t* gen, int64_t min, int64_t max) {
+    if (!gen || min > max) return min;
     
-    memset(&suite->stats, 0, sizeof(test_stats_t));
+    uint64_t choice = gen_draw(gen, (uint64_t)max - (uint64_t)min);
+    int64_t value = gen_int_from_choice(choice, min, max);
+    gen_describe(gen, "%sint(%" PRId64 ")", gen->report_len ? " " : "", value);
+    return value;
+}
+
+bool test_gen_bool(test_gen_t* gen) {
+    if (!gen) return false;
     
-    // stats calc from test cases
-    test_case_t* current_case = suite->test_cases;
-    while (current_case) {
-        for (int i = 0; i < current_case->result_count; i++) {
-            switch (current_case->results[i]) {
-                case STATUS_SUCCESS:
-                    suite->stats.success_count++;
-                    break;
-                case STATUS_UNEXPECTED_OUTPUT:
-                    suite->stats.unexpected_output_count++;
-                    break;
-                case STATUS_EXPECTED_BUILD_ERROR:
-                    suite->stats.expected_build_error_count++;
-                    break;
-                case STATUS_BUILD_ERROR:
-                    suite->stats.build_error_count++;
-                    break;
-                case STATUS_EXPECTED_RUNTIME_ERROR:
-                    suite->stats.expected_runtime_error_count++;
-                    break;
-                case STATUS_RUNTIME_ERROR:
-                    suite->stats.runtime_error_count++;
+    bool value = gen_draw(gen, 1) != 0;
+    gen_describe(gen, "%sbool(%s)", gen->report_len ? " " : "", value ? "true" : "false");
+    return value;
+}
+
+size_t test_gen_size(test_gen_t* gen, size_t max) {
+    if (!gen) return 0;
+    
+    size_t value = (size_t)gen_draw(gen, max);
+    gen_describe(gen, "%ssize(%zu)", gen->report_len ? " " : "", value);
+    return value;
+}
+
+size_t test_gen_bytes(test_gen_t* gen, uint8_t* buffer, size_t max_size) {
+    if (!gen || !buffer) return 0;
+    
+    size_t size = (size_t)gen_draw(gen, max_size);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = (uint8_t)gen_draw(gen, 255);
+    }
+    
+    gen_describe(gen, "%sbytes[%zu](", gen->report_len ? " " : "", size);
+    for (size_t i = 0; i < size; i++) {
+        gen_describe(gen, i ? " %02x" : "%02x", buffer[i]);
+    }
+    gen_describe(gen, ")");
+    return size;
+}
+
+size_t test_gen_string(test_gen_t* gen, char* buffer, size_t buffer_size) {
+    static const char alphabet[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+        " _-.,:;!?/\\'\"()[]{}<>@#$%^&*+=|~`\t\n";
+    
+    if (!gen || !buffer || buffer_size == 0) return 0;
+    
+    size_t length = (size_t)gen_draw(gen, buffer_size - 1);
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = alphabet[gen_draw(gen, sizeof(alphabet) - 2)];
+    }
+    buffer[length] = '\0';
+    
+    gen_describe(gen, "%sstring(\"", gen->report_len ? " " : "");
+    for (size_t i = 0; i < length; i++) {
+        switch (buffer[i]) {
+            case '\n': gen_describe(gen, "\\n"); break;
+            case '\t': gen_describe(gen, "\\t"); break;
+            case '"': gen_describe(gen, "\\\""); break;
+            case '\\': gen_describe(gen, "\\\\"); break;
+            default: gen_describe(gen, "%c", buffer[i]); break;
+        }
+    }
+    gen_describe(gen, "\")");
+    return length;
+}
+
+size_t test_gen_ints(test_gen_t* gen, int64_t* values, size_t max_count, int64_t min, int64_t max) {
+    if (!gen || !values || min > max) return 0;
+    
+    size_t count = (size_t)gen_draw(gen, max_count);
+    uint64_t span = (uint64_t)max - (uint64_t)min;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = gen_int_from_choice(gen_draw(gen, span), min, max);
+    }
+    
+    gen_describe(gen, "%sints[%zu](", gen->report_len ? " " : "", count);
+    for (size_t i = 0; i < count; i++) {
+        gen_describe(gen, i ? ", %" PRId64 : "%" PRId64, values[i]);
+    }
+    gen_describe(gen, ")");
+    return count;
+}
+
+typedef struct {
+    test_case_t* test_case;
+    uint64_t seed;
+    int next_iteration;
+    int failed_iteration;
+    test_status_t failed_status;
+    uint64_t* failed_choices;
+    size_t failed_count;
+    pthread_mutex_t lock;
+} property_run_t;
+
+static uint64_t property_iteration_seed(const property_run_t* run, int iteration) {
+    return splitmix64(run->seed ^ ((uint64_t)iteration * 0x9E3779B97F4A7C15ULL));
+}
+
+// iterations are handed out in chunks; the lowest failing iteration wins so
+// the reported counterexample does not depend on the number of threads
+static void* property_worker(void* arg) {
+    property_run_t* run = arg;
+    test_case_t* test_case = run->test_case;
+    test_gen_t gen;
+    memset(&gen, 0, sizeof(gen));
+    
+    for (;;) {
+        int start = __atomic_fetch_add(&run->next_iteration, PROPERTY_CHUNK, __ATOMIC_RELAXED);
+        if (start >= test_case->property_iterations ||
+            start > __atomic_load_n(&run->failed_iteration, __ATOMIC_RELAXED)) {
+            break;
+        }
+        
+        int end = start + PROPERTY_CHUNK;
+        if (end > test_case->property_iterations) end = test_case->property_iterations;
+        
+        for (int i = start; i < end; i++) {
+            gen_seed(&gen, property_iteration_seed(run, i));
+            gen_reset(&gen, NULL, 0);
+            
+            test_status_t status = test_case->property_func(&gen);
+            if (!status_is_failure(status)) continue;
+            
+            pthread_mutex_lock(&run->lock);
+            if (i < run->failed_iteration) {
+                uint64_t* choices = malloc((gen.choice_count + 1) * sizeof(uint64_t));
+                if (choices) {
+                    memcpy(choices, gen.choices, gen.choice_count * sizeof(uint64_t));
+                    free(run->failed_choices);
+                    run->failed_choices = choices;
+                    run->failed_count = gen.choice_count;
+                    run->failed_status = status;
+                    __atomic_store_n(&run->failed_iteration, i, __ATOMIC_RELAXED);
+                }
+            }
+            pthread_mutex_unlock(&run->lock);
+            break;
+        }
+    }
+    
+    free(gen.choices);
+    return NULL;
+}
+
+static bool property_try_candidate(test_case_t* test_case, test_gen_t* gen,
+                                   uint64_t** choices, size_t* count,
+                                   test_status_t* status, int* runs) {
+    (*runs)++;
+    gen_reset(gen, *choices, *count);
+    test_status_t candidate_status = test_case->property_func(gen);
+    if (!status_is_failure(candidate_status)) return false;
+    
+    // keep only the choices the property actually consumed
+    size_t used = gen->choice_count;
+    if (used > *count) used = *count;
+    memcpy(*choices, gen->choices, used * sizeof(uint64_t));
+    *count = used;
+    *status = candidate_status;
+    return true;
+}
+
+static int property_shrink(test_case_t* test_case, uint64_t* choices, size_t* count,
+                           test_status_t* status) {
+    test_gen_t gen;
+    memset(&gen, 0, sizeof(gen));
+    
+    uint64_t* candidate = malloc((*count + 1) * sizeof(uint64_t));
+    if (!candidate) return 0;
+    
+    int runs = 0;
+    int shrinks = 0;
+    bool improved = true;
+    while (improved && runs < PROPERTY_MAX_SHRINK_RUNS) {
+        improved = false;
+        
+        // drop blocks of choices, largest first
+        for (size_t block = 8; block > 0 && runs < PROPERTY_MAX_SHRINK_RUNS; block /= 2) {
+            for (size_t i = *count >= block ? *count - block + 1 : 0; i-- > 0;) {
+                if (i + block > *count) continue;
+                
+                size_t candidate_count = *count - block;
+                memcpy(candidate, choices, i * sizeof(uint64_t));
+                memcpy(candidate + i, choices + i + block, (candidate_count - i) * sizeof(uint64_t));
+                if (property_try_candidate(test_case, &gen, &candidate, &candidate_count, status, &runs)) {
+                    memcpy(choices, candidate, candidate_count * sizeof(uint64_t));
+                    *count = candidate_count;
+                    improved = true;
+                    shrinks++;
+                }
+                if (runs >= PROPERTY_MAX_SHRINK_RUNS) break;
+            }
+        }
+        
+        // shorten length-prefixed data: lower a choice and drop the one after it
+        for (size_t i = 0; i + 1 < *count && runs < PROPERTY_MAX_SHRINK_RUNS; i++) {
+            while (choices[i] > 0 && i + 1 < *count && runs < PROPERTY_MAX_SHRINK_RUNS) {
+                size_t candidate_count = *count - 1;
+                memcpy(candidate, choices, (i + 1) * sizeof(uint64_t));
+                memcpy(candidate + i + 1, choices + i + 2, (candidate_count - i - 1) * sizeof(uint64_t));
+                candidate[i]--;
+                if (!property_try_candidate(test_case, &gen, &candidate, &candidate_count, status, &runs)) {
                     break;
+                }
+                memcpy(choices, candidate, candidate_count * sizeof(uint64_t));
+                *count = candidate_count;
+                improved = true;
+                shrinks++;
+            }
+        }
+        
+        // minimize each choice by binary search towards zero, then again over
+        // every other choice: ints alternate signs (0, -1, 1, -2, ...), so the
+        // first search stops wherever the value of the other sign passes
+        for (size_t i = 0; i < *count && runs < PROPERTY_MAX_SHRINK_RUNS; i++) {
+            for (uint64_t step = 1; step <= 2 && i < *count; step++) {
+                uint64_t base = choices[i] % step;
+                uint64_t low = 0;
+                uint64_t high = choices[i] / step;
+                while (low < high && runs < PROPERTY_MAX_SHRINK_RUNS) {
+                    uint64_t mid = low + (high - low) / 2;
+                    size_t candidate_count = *count;
+                    memcpy(candidate, choices, *count * sizeof(uint64_t));
+                    candidate[i] = base + mid * step;
+                    if (property_try_candidate(test_case, &gen, &candidate, &candidate_count, status, &runs)) {
+                        memcpy(choices, candidate, candidate_count * sizeof(uint64_t));
+                        *count = candidate_count;
+                        improved = true;
+                        shrinks++;
+                        if (i >= *count) break;
+                        high = choices[i] / step;
+                    } else {
+                        low = mid + 1;
+                    }
+                }
+            }
+        }
+    }
+    
+    free(candidate);
+    free(gen.choices);
+    return shrinks;
+}
+
+static test_status_t run_property_case(test_runner_t* runner, test_case_t* test_case, int threads) {
+    property_run_t run;
+    run.test_case = test_case;
+    run.seed = runner->seed ^ hash_string(test_case->name);
+    run.next_iteration = 0;
+    run.failed_iteration = INT_MAX;
+    run.failed_status = STATUS_SUCCESS;
+    run.failed_choices = NULL;
+    run.failed_count = 0;
+    pthread_mutex_init(&run.lock, NULL);
+    
+    int chunks = (test_case->property_iterations + PROPERTY_CHUNK - 1) / PROPERTY_CHUNK;
+    if (threads > chunks) threads = chunks;
+    
+    run_threads(threads, property_worker, &run);
+    pthread_mutex_destroy(&run.lock);
+    
+    if (run.failed_iteration == INT_MAX) return STATUS_SUCCESS;
+    
+    test_status_t status = run.failed_status;
+    int shrinks = property_shrink(test_case, run.failed_choices, &run.failed_count, &status);
+    
+    // replay the minimal input once more to describe it
+    test_gen_t gen;
+    memset(&gen, 0, sizeof(gen));
+    char* report = malloc(REPORT_LIMIT);
+    if (report) {
+        int header = snprintf(report, REPORT_LIMIT,
+                              "counterexample (seed 0x%016" PRIx64 ", iteration %d, %d shrinks:",
+                              runner->seed, run.failed_iteration, shrinks);
+        gen.report = report;
+        gen.report_len = header;
+        gen_reset(&gen, run.failed_choices, run.failed_count);
+        test_case->property_func(&gen);
+        gen_describe(&gen, ")");
+        
+        free(test_case->report);
+        test_case->report = report;
+    }
+    
+    free(gen.choices);
+    free(run.failed_choices);
+    return status;
+}
+
+// failing results are rare, so their details live in a side table of the
+// case sorted by result index, with every string in one arena
+typedef struct test_failure test_failure_t;
+
+typedef struct {
+    int result;
+    test_diagnostic_t diagnostic;
+    const test_failure_t* assertion;    // raw operands until the message is needed
+} diagnostic_record_t;
+
+struct test_diagnostics {
+    arena_t arena;
+    diagnostic_record_t* records;
+    int count;
+    int capacity;
+};
+
+static void free_diagnostics(test_case_t* test_case) {
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    if (!diagnostics) return;
+    
+    arena_free(&diagnostics->arena);
+    free(diagnostics->records);
+    free(diagnostics);
+    test_case->diagnostics = NULL;
+}
+
+void test_case_destroy(test_case_t* test_case) {
+    if (!test_case) return;
+    
+    free(test_case->results);
+    free(test_case->fuzz_corpus);
+    free(test_case->report);
+    free_diagnostics(test_case);
+    free(test_case);
+}
+
+void test_case_destroy_siblings(test_case_t* test_case) {
+    while (test_case) {
+        test_case_t* next = test_case->next;
+        test_case->next = NULL; 
+        test_case_destroy(test_case);
+        test_case = next;
+    }
+}
+
+static int reserve_results(test_case_t* test_case, int capacity) {
+    if (capacity <= test_case->result_capacity) return 0;
+    
+    test_status_t* new_results = realloc(test_case->results, 
+                                       capacity * sizeof(test_status_t));
+    if (!new_results) {
+        return -1;  // realloc error
+    }
+    
+    test_case->results = new_results;
+    test_case->result_capacity = capacity;
+    return 0;
+}
+
+// appends are short, so threads recording into the same case just spin
+static void lock_results(test_case_t* test_case) {
+    while (__atomic_exchange_n(&test_case->result_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&test_case->result_lock, __ATOMIC_RELAXED)) {
+            sched_yield();
+        }
+    }
+}
+
+static void unlock_results(test_case_t* test_case) {
+    __atomic_store_n(&test_case->result_lock, 0, __ATOMIC_RELEASE);
+}
+
+static int append_result(test_case_t* test_case, test_status_t status) {
+    // array resize
+    if (test_case->result_count >= test_case->result_capacity) {
+        int new_capacity = test_case->result_capacity == 0 ? 
+                          INITIAL_RESULT_CAPACITY : 
+                          test_case->result_capacity * 2;
+        
+        if (reserve_results(test_case, new_capacity) != 0) {
+            return -1;
+        }
+    }
+    
+    test_case->results[test_case->result_count] = status;
+    test_case->result_count++;
+    return 0;
+}
+
+int test_case_add_result(test_case_t* test_case, test_status_t status) {
+    if (!test_case) return -1;
+    
+    lock_results(test_case);
+    int result = append_result(test_case, status);
+    unlock_results(test_case);
+    return result;
+}
+
+// the whole batch lands next to each other even with other threads appending
+int test_case_add_results_va(test_case_t* test_case, int count, ...) {
+    if (!test_case || count <= 0) return -1;
+    
+    va_list args;
+    va_start(args, count);
+    
+    int result = 0;
+    lock_results(test_case);
+    for (int i = 0; i < count && result == 0; i++) {
+        test_status_t status = va_arg(args, test_status_t);
+        result = append_result(test_case, status);  // add result failed
+    }
+    unlock_results(test_case);
+    
+    va_end(args);
+    return result;
+}
+
+void test_case_set_version(test_case_t* test_case, const char* version) {
+    if (!test_case) return;
+    
+    test_case->version = version ? hash_string(version) : 0;
+    if (version && test_case->version == 0) test_case->version = 1;
+}
+
+// assertion failures are captured raw on the failing thread and only turned
+// into text when someone reads them
+typedef enum {
+    FAILURE_BOOL,
+    FAILURE_INT,
+    FAILURE_STR,
+    FAILURE_MEM
+} failure_kind_t;
+
+struct test_failure {
+    const char* file;
+    int line;
+    const char* expression;
+    failure_kind_t kind;
+    uint64_t left;
+    uint64_t right;
+    int flags;
+    size_t offset;
+    size_t length;
+    char operands[2][ASSERT_OPERAND_LIMIT];
+};
+
+static __thread test_failure_t pending_failure;
+static __thread bool failure_pending;
+
+static test_failure_t* begin_failure(const char* file, int line, const char* expression,
+                                     failure_kind_t kind) {
+    test_failure_t* failure = &pending_failure;
+    memset(failure, 0, sizeof(*failure));
+    failure->file = file;
+    failure->line = line;
+    failure->expression = expression;
+    failure->kind = kind;
+    failure_pending = true;
+    return failure;
+}
+
+void test_assert_failed(const char* file, int line, const char* expression) {
+    begin_failure(file, line, expression, FAILURE_BOOL);
+}
+
+void test_assert_failed_int(const char* file, int line, const char* expression,
+                            uint64_t left, uint64_t right, int flags) {
+    test_failure_t* failure = begin_failure(file, line, expression, FAILURE_INT);
+    failure->left = left;
+    failure->right = right;
+    failure->flags = flags;
+}
+
+// the strings may not outlive the test, so a prefix is copied now
+void test_assert_failed_str(const char* file, int line, const char* expression,
+                            const char* left, const char* right) {
+    test_failure_t* failure = begin_failure(file, line, expression, FAILURE_STR);
+    const char* operands[2] = { left, right };
+    for (int i = 0; i < 2; i++) {
+        if (!operands[i]) {
+            snprintf(failure->operands[i], ASSERT_OPERAND_LIMIT, "NULL");
+        } else if (strlen(operands[i]) + 3 <= ASSERT_OPERAND_LIMIT) {
+            snprintf(failure->operands[i], ASSERT_OPERAND_LIMIT, "\"%s\"", operands[i]);
+        } else {
+            snprintf(failure->operands[i], ASSERT_OPERAND_LIMIT, "\"%.*s\"...",
+                     ASSERT_OPERAND_LIMIT - 6, operands[i]);
+        }
+    }
+}
+
+// keeps the bytes around the first difference
+void test_assert_failed_mem(const char* file, int line, const char* expression,
+                            const void* left, const void* right, size_t size) {
+    test_failure_t* failure = begin_failure(file, line, expression, FAILURE_MEM);
+    const unsigned char* bytes[2] = { left, right };
+    
+    size_t offset = 0;
+    while (offset < size && bytes[0][offset] == bytes[1][offset]) offset++;
+    failure->offset = offset;
+    
+    size_t begin = offset > 4 ? offset - 4 : 0;
+    size_t length = size - begin < ASSERT_OPERAND_LIMIT ? size - begin : ASSERT_OPERAND_LIMIT;
+    failure->length = length;
+    memcpy(failure->operands[0], bytes[0] + begin, length);
+    memcpy(failure->operands[1], bytes[1] + begin, length);
+}
+
+static void clear_failure(void) {
+    failure_pending = false;
+}
+
+static const char* arena_copy(arena_t* arena, const char* string) {
+    return string ? arena_strndup(arena, string, strlen(string)) : NULL;
+}
+
+// callers hold the result lock
+static diagnostic_record_t* find_diagnostic(const struct test_diagnostics* diagnostics, int result) {
+    if (!diagnostics) return NULL;
+    
+    int low = 0;
+    int high = diagnostics->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (diagnostics->records[middle].result < result) low = middle + 1;
+        else high = middle;
+    }
+    return low < diagnostics->count && diagnostics->records[low].result == result ?
+           &diagnostics->records[low] : NULL;
+}
+
+// a result gets one record, a later one for the same result replaces it
+static int store_diagnostic(test_case_t* test_case, int result, const test_diagnostic_t* diagnostic,
+                            const test_failure_t* assertion) {
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    if (!diagnostics) {
+        diagnostics = calloc(1, sizeof(struct test_diagnostics));
+        if (!diagnostics) return -1;
+        test_case->diagnostics = diagnostics;
+    }
+    
+    // results are recorded in order, so this is nearly always an append
+    int position = diagnostics->count;
+    while (position > 0 && diagnostics->records[position - 1].result > result) position--;
+    
+    diagnostic_record_t* record;
+    if (position > 0 && diagnostics->records[position - 1].result == result) {
+        record = &diagnostics->records[position - 1];
+    } else {
+        if (diagnostics->count >= diagnostics->capacity) {
+            int new_capacity = diagnostics->capacity == 0 ? 4 : diagnostics->capacity * 2;
+            diagnostic_record_t* new_records = realloc(diagnostics->records,
+                                                       new_capacity * sizeof(diagnostic_record_t));
+            if (!new_records) return -1;
+            diagnostics->records = new_records;
+            diagnostics->capacity = new_capacity;
+        }
+        memmove(&diagnostics->records[position + 1], &diagnostics->records[position],
+                (diagnostics->count - position) * sizeof(diagnostic_record_t));
+        diagnostics->count++;
+        record = &diagnostics->records[position];
+    }
+    
+    arena_t* arena = &diagnostics->arena;
+    record->result = result;
+    record->diagnostic.message = arena_copy(arena, diagnostic->message);
+    record->diagnostic.file = arena_copy(arena, diagnostic->file);
+    record->diagnostic.line = diagnostic->line;
+    record->diagnostic.signal = diagnostic->signal;
+    record->diagnostic.output = arena_copy(arena, diagnostic->output);
+    record->assertion = NULL;
+    if (assertion) {
+        test_failure_t* copy = arena_alloc(arena, sizeof(test_failure_t));
+        if (copy) *copy = *assertion;
+        record->assertion = copy;
+    }
+    
+    // partial copies are kept, the caller only learns something is missing
+    if ((diagnostic->message && !record->diagnostic.message) ||
+        (diagnostic->file && !record->diagnostic.file) ||
+        (diagnostic->output && !record->diagnostic.output) ||
+        (assertion && !record->assertion)) {
+        return -1;
+    }
+    return 0;
+}
+
+int test_case_add_diagnostic(test_case_t* test_case, int result, const test_diagnostic_t* diagnostic) {
+    if (!test_case || !diagnostic || result < 0) return -1;
+    
+    lock_results(test_case);
+    int status = store_diagnostic(test_case, result, diagnostic, NULL);
+    unlock_results(test_case);
+    return status;
+}
+
+static void attach_failure(test_case_t* test_case, int result, const test_failure_t* failure) {
+    test_diagnostic_t diagnostic = { NULL, failure->file, failure->line, 0, NULL };
+    lock_results(test_case);
+    store_diagnostic(test_case, result, &diagnostic, failure);
+    unlock_results(test_case);
+}
+
+// hands this thread's pending assertion failure to the given result
+static void take_failure(test_case_t* test_case, int result) {
+    if (!failure_pending) return;
+    failure_pending = false;
+    attach_failure(test_case, result, &pending_failure);
+}
+
+// adds a result produced on this thread together with the assertion behind it
+static int add_case_result(test_case_t* test_case, test_status_t status) {
+    lock_results(test_case);
+    int index = test_case->result_count;
+    int result = append_result(test_case, status);
+    unlock_results(test_case);
+    
+    if (result == 0 && status_is_failure(status)) {
+        take_failure(test_case, index);
+    } else {
+        clear_failure();
+    }
+    return result;
+}
+
+static void format_operand(const test_failure_t* failure, int index, char* buffer, size_t size) {
+    uint64_t value = index == 0 ? failure->left : failure->right;
+    if (failure->flags & (index == 0 ? TEST_ASSERT_LEFT_SIGNED : TEST_ASSERT_RIGHT_SIGNED)) {
+        snprintf(buffer, size, "%" PRId64, (int64_t)value);
+    } else {
+        snprintf(buffer, size, "%" PRIu64, value);
+    }
+}
+
+static void format_failure(const test_failure_t* failure, char* buffer, size_t size) {
+    size_t length = 0;
+    int written = snprintf(buffer, size, "%s", failure->expression);
+    if (written > 0) length = (size_t)written;
+    
+    char left[32];
+    char right[32];
+    switch (failure->kind) {
+        case FAILURE_BOOL:
+            break;
+        case FAILURE_INT:
+            format_operand(failure, 0, left, sizeof(left));
+            format_operand(failure, 1, right, sizeof(right));
+            if (length < size) snprintf(buffer + length, size - length, " (%s vs %s)", left, right);
+            break;
+        case FAILURE_STR:
+            if (length < size) {
+                snprintf(buffer + length, size - length, " (%s vs %s)",
+                         failure->operands[0], failure->operands[1]);
+            }
+            break;
+        case FAILURE_MEM:
+            // hex dump of both sides starting a few bytes before the difference
+            written = length < size ? snprintf(buffer + length, size - length,
+                                               " (differ at byte %zu:", failure->offset) : 0;
+            if (written > 0) length += (size_t)written;
+            for (int side = 0; side < 2; side++) {
+                for (size_t i = 0; i < failure->length && length < size; i++) {
+                    written = snprintf(buffer + length, size - length, " %02x",
+                                       (unsigned char)failure->operands[side][i]);
+                    if (written > 0) length += (size_t)written;
+                }
+                if (length < size) {
+                    written = snprintf(buffer + length, size - length, side == 0 ? " vs" : ")");
+                    if (written > 0) length += (size_t)written;
+                }
+            }
+            break;
+    }
+}
+
+// assertion messages are formatted the first time anyone looks, callers
+// hold the result lock
+static const test_diagnostic_t* resolve_diagnostic(struct test_diagnostics* diagnostics,
+                                                   diagnostic_record_t* record) {
+    if (record->assertion && !record->diagnostic.message) {
+        char message[REPORT_LIMIT];
+        format_failure(record->assertion, message, sizeof(message));
+        record->diagnostic.message = arena_copy(&diagnostics->arena, message);
+    }
+    return &record->diagnostic;
+}
+
+// copied under the lock, records move when another thread adds one; the
+// strings live in the arena, which only grows until the case is reset
+int test_case_diagnostic(test_case_t* test_case, int result, test_diagnostic_t* diagnostic) {
+    if (!test_case || !diagnostic) return -1;
+    
+    lock_results(test_case);
+    diagnostic_record_t* record = find_diagnostic(test_case->diagnostics, result);
+    if (record) *diagnostic = *resolve_diagnostic(test_case->diagnostics, record);
+    unlock_results(test_case);
+    return record ? 0 : -1;
+}
+
+// "file:line: message (signal N)", each part only if known
+static void format_diagnostic(const test_diagnostic_t* diagnostic, char* buffer, size_t size) {
+    size_t length = 0;
+    int written = 0;
+    buffer[0] = '\0';
+    if (diagnostic->file) {
+        written = diagnostic->line > 0 ?
+                  snprintf(buffer, size, "%s:%d:", diagnostic->file, diagnostic->line) :
+                  snprintf(buffer, size, "%s:", diagnostic->file);
+        if (written > 0) length = (size_t)written;
+    }
+    if (diagnostic->message && length < size) {
+        written = snprintf(buffer + length, size - length, "%s%s", length ? " " : "", diagnostic->message);
+        if (written > 0) length += (size_t)written;
+    }
+    if (diagnostic->signal > 0 && length < size) {
+        snprintf(buffer + length, size - length, "%s(signal %d)", length ? " " : "", diagnostic->signal);
+    }
+}
+
+test_case_t* test_case_create_fuzz(const char* name, test_fuzz_func_t fuzz_func,
+                                   const char* corpus_dir) {
+    if (!fuzz_func || !corpus_dir) return NULL;
+    
+    test_case_t* test_case = test_case_create(name, NULL);
+    if (!test_case) return NULL;
+    
+    test_case->fuzz_corpus = strdup(corpus_dir);
+    if (!test_case->fuzz_corpus) {
+        test_case_destroy(test_case);
+        return NULL;
+    }
+    
+    test_case->kind = TEST_KIND_FUZZ;
+    test_case->fuzz_func = fuzz_func;
+    return test_case;
+}
+
+int test_fuzz_run_one(test_fuzz_func_t fuzz_func, const uint8_t* data, size_t size) {
+    // the fuzzing engine only notices crashes
+    if (status_is_failure(fuzz_func(data, size))) {
+        abort();
+    }
+    return 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void append_failed_input(test_case_t* test_case, const char* name) {
+    if (!test_case->report) {
+        test_case->report = malloc(REPORT_LIMIT);
+        if (!test_case->report) return;
+        strcpy(test_case->report, "failing inputs:");
+    }
+    
+    size_t length = strlen(test_case->report);
+    if (length + strlen(name) + 5 < REPORT_LIMIT) {
+        snprintf(test_case->report + length, REPORT_LIMIT - length, " %s", name);
+    } else if (length + 5 < REPORT_LIMIT && strcmp(test_case->report + length - 4, " ...") != 0) {
+        strcpy(test_case->report + length, " ...");
+    }
+}
+
+// corpus inputs are replayed in name order so runs are deterministic
+static void run_fuzz_case(test_case_t* test_case) {
+    DIR* dir = opendir(test_case->fuzz_corpus);
+    if (!dir) {
+        fprintf(stderr, "Warning: Cannot open corpus %s for %s\n",
+               test_case->fuzz_corpus, test_case->name);
+        test_case_add_result(test_case, STATUS_RUNTIME_ERROR);
+        return;
+    }
+    
+    // all names share one buffer instead of a strdup per file
+    char* names = NULL;
+    size_t names_size = 0;
+    size_t names_capacity = 0;
+    size_t count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        
+        size_t length = strlen(entry->d_name) + 1;
+        if (names_size + length > names_capacity) {
+            size_t new_capacity = names_capacity == 0 ? 4096 : names_capacity * 2;
+            while (new_capacity < names_size + length) new_capacity *= 2;
+            char* new_names = realloc(names, new_capacity);
+            if (!new_names) {
+                // a partial corpus would pass on inputs it never saw
+                fprintf(stderr, "Warning: Cannot read corpus %s for %s\n",
+                        test_case->fuzz_corpus, test_case->name);
+                test_case_add_result(test_case, STATUS_RUNTIME_ERROR);
+                free(names);
+                closedir(dir);
+                return;
+            }
+            names = new_names;
+            names_capacity = new_capacity;
+        }
+        memcpy(names + names_size, entry->d_name, length);
+        names_size += length;
+        count++;
+    }
+    
+    char** order = count > 0 ? malloc(count * sizeof(char*)) : NULL;
+    if (count > 0 && (!order || reserve_results(test_case, test_case->result_count + (int)count) != 0)) {
+        fprintf(stderr, "Warning: Failed to add test result for %s\n", test_case->name);
+        free(order);
+        free(names);
+        closedir(dir);
+        return;
+    }
+    
+    char* name = names;
+    for (size_t i = 0; i < count; i++) {
+        order[i] = name;
+        name += strlen(name) + 1;
+    }
+    qsort(order, count, sizeof(char*), compare_names);
+    
+    int dir_fd = dirfd(dir);
+    for (size_t i = 0; i < count; i++) {
+        int fd = openat(dir_fd, order[i], O_RDONLY);
+        if (fd < 0) continue;
+        
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close(fd);
+            continue;
+        }
+        
+        // map instead of read so the page cache is used directly
+        size_t size = (size_t)info.st_size;
+        static const uint8_t empty = 0;
+        const uint8_t* data = &empty;
+        if (size > 0) {
+            void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                continue;
+            }
+            data = mapping;
+        }
+        close(fd);
+        
+        test_status_t status = test_case->fuzz_func(data, size);
+        if (size > 0) munmap((void*)data, size);
+        
+        add_case_result(test_case, status);
+        if (status_is_failure(status)) {
+            append_failed_input(test_case, order[i]);
+        }
+    }
+    
+    free(order);
+    free(names);
+    closedir(dir);
+}
+
+test_case_t* test_case_create_stress(const char* name, test_stress_func_t stress_func,
+                                     int threads, uint64_t iterations) {
+    if (!stress_func || threads < 0) return NULL;
+    
+    test_case_t* test_case = test_case_create(name, NULL);
+    if (!test_case) return NULL;
+    
+    test_case->kind = TEST_KIND_STRESS;
+    test_case->stress_func = stress_func;
+    test_case->stress_threads = threads;
+    test_case->stress_iterations = iterations > 0 ? iterations : DEFAULT_STRESS_ITERATIONS;
+    return test_case;
+}
+
+void test_case_set_stress_duration(test_case_t* test_case, uint64_t duration_ms) {
+    if (!test_case) return;
+    test_case->stress_duration_ns = duration_ms * 1000000ULL;
+}
+
+typedef struct {
+    test_case_t* test_case;
+    pthread_mutex_t gate;       // held until the barrier fits the threads that started
+    bool aborted;
+    pthread_barrier_t barrier;
+    int next_thread;
+    test_status_t* statuses;
+    uint64_t* calls;
+    uint64_t* failures;
+    uint64_t* elapsed_ns;
+} stress_run_t;
+
+static void* stress_worker(void* arg) {
+    stress_run_t* run = arg;
+    test_case_t* test_case = run->test_case;
+    int thread = __atomic_fetch_add(&run->next_thread, 1, __ATOMIC_RELAXED);
+    uint64_t iterations = test_case->stress_iterations;
+    uint64_t duration = test_case->stress_duration_ns;
+    test_status_t status = STATUS_SUCCESS;
+    uint64_t calls = 0;
+    uint64_t failures = 0;
+    clear_failure();
+    
+    pthread_mutex_lock(&run->gate);
+    pthread_mutex_unlock(&run->gate);
+    if (run->aborted) return NULL;
+    
+    // everyone starts hammering at the same moment
+    pthread_barrier_wait(&run->barrier);
+    uint64_t start = monotonic_ns();
+    uint64_t now = start;
+    while (duration > 0 ? now - start < duration : calls < iterations) {
+        test_status_t result = test_case->stress_func(thread);
+        calls++;
+        
+        // a thread reports its first failure, or else its first other status
+        if (status_is_failure(result)) {
+            failures++;
+            if (!status_is_failure(status)) {
+                status = result;
+                take_failure(test_case, thread);
+            }
+        } else if (status == STATUS_SUCCESS) {
+            status = result;
+        }
+        if (duration > 0) now = monotonic_ns();
+    }
+    
+    run->statuses[thread] = status;
+    run->calls[thread] = calls;
+    run->failures[thread] = failures;
+    run->elapsed_ns[thread] = monotonic_ns() - start;
+    clear_failure();
+    return NULL;
+}
+
+static void format_rate(double rate, char* buffer, size_t size) {
+    if (rate >= 1e9) {
+        snprintf(buffer, size, "%.2fG", rate / 1e9);
+    } else if (rate >= 1e6) {
+        snprintf(buffer, size, "%.2fM", rate / 1e6);
+    } else if (rate >= 1e3) {
+        snprintf(buffer, size, "%.1fk", rate / 1e3);
+    } else {
+        snprintf(buffer, size, "%.0f", rate);
+    }
+}
+
+// one result per thread, throughput goes into the report line
+static void run_stress_case(test_case_t* test_case) {
+    int threads = test_case->stress_threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    
+    stress_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.test_case = test_case;
+    run.statuses = calloc(threads, sizeof(test_status_t));
+    run.calls = calloc(threads, sizeof(uint64_t));
+    run.failures = calloc(threads, sizeof(uint64_t));
+    run.elapsed_ns = calloc(threads, sizeof(uint64_t));
+    pthread_t* workers = threads > 1 ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+    if (!run.statuses || !run.calls || !run.failures || !run.elapsed_ns || (threads > 1 && !workers) ||
+        reserve_results(test_case, threads) != 0) {
+        fprintf(stderr, "Warning: Failed to start stress test %s\n", test_case->name);
+        test_case_add_result(test_case, STATUS_RUNTIME_ERROR);
+        free(workers);
+        free(run.statuses);
+        free(run.calls);
+        free(run.failures);
+        free(run.elapsed_ns);
+        return;
+    }
+    
+    // workers wait at the gate, so the barrier can be sized to the threads
+    // that actually started before anyone waits on it
+    pthread_mutex_init(&run.gate, NULL);
+    pthread_mutex_lock(&run.gate);
+    int started = workers ? start_threads(workers, threads, stress_worker, &run) + 1 : 1;
+    run.aborted = pthread_barrier_init(&run.barrier, NULL, (unsigned)started) != 0;
+    pthread_mutex_unlock(&run.gate);
+    if (!run.aborted) stress_worker(&run);
+    join_threads(workers, started - 1);
+    free(workers);
+    pthread_mutex_destroy(&run.gate);
+    
+    if (run.aborted) {
+        fprintf(stderr, "Warning: Failed to start stress test %s\n", test_case->name);
+        test_case_add_result(test_case, STATUS_RUNTIME_ERROR);
+        free(run.statuses);
+        free(run.calls);
+        free(run.failures);
+        free(run.elapsed_ns);
+        return;
+    }
+    pthread_barrier_destroy(&run.barrier);
+    if (started < threads) {
+        fprintf(stderr, "Warning: Started %d of %d stress threads for %s\n", started, threads,
+                test_case->name);
+        threads = started;
+    }
+    
+    uint64_t total_calls = 0;
+    uint64_t total_failures = 0;
+    uint64_t slowest = 1;
+    for (int i = 0; i < threads; i++) {
+        test_case->results[test_case->result_count++] = run.statuses[i];
+        total_calls += run.calls[i];
+        total_failures += run.failures[i];
+        if (run.elapsed_ns[i] > slowest) slowest = run.elapsed_ns[i];
+    }
+    
+    char* report = malloc(REPORT_LIMIT);
+    if (report) {
+        char rate[32];
+        format_rate(total_calls * 1e9 / (double)slowest, rate, sizeof(rate));
+        int length = snprintf(report, REPORT_LIMIT, "%d thread%s, %" PRIu64 " calls, %s calls/s",
+                              threads, threads == 1 ? "" : "s", total_calls, rate);
+        if (total_failures > 0 && length < REPORT_LIMIT) {
+            length += snprintf(report + length, REPORT_LIMIT - length, ", %" PRIu64 " failed",
+                               total_failures);
+        }
+        if (length < REPORT_LIMIT) {
+            length += snprintf(report + length, REPORT_LIMIT - length, " (per thread:");
+        }
+        for (int i = 0; i < threads && length < REPORT_LIMIT; i++) {
+            format_rate(run.calls[i] * 1e9 / (double)(run.elapsed_ns[i] ? run.elapsed_ns[i] : 1),
+                        rate, sizeof(rate));
+            length += snprintf(report + length, REPORT_LIMIT - length, " %s", rate);
+        }
+        if (length < REPORT_LIMIT) {
+            snprintf(report + length, REPORT_LIMIT - length, ")");
+        }
+        free(test_case->report);
+        test_case->report = report;
+    }
+    
+    free(run.statuses);
+    free(run.calls);
+    free(run.failures);
+    free(run.elapsed_ns);
+}
+
+test_case_t* test_case_create_async(const char* name, test_async_func_t async_func, uint64_t timeout_ms) {
+    if (!async_func) return NULL;
+    
+    test_case_t* test_case = test_case_create(name, NULL);
+    if (!test_case) return NULL;
+    
+    test_case->kind = TEST_KIND_ASYNC;
+    test_case->async_func = async_func;
+    test_case->async_timeout_ns = (timeout_ms > 0 ? timeout_ms : DEFAULT_ASYNC_TIMEOUT_MS) * 1000000ULL;
+    return test_case;
+}
+
+typedef struct async_watch {
+    test_async_t* async;
+    int fd;
+    test_async_io_func_t callback;
+    void* data;
+    struct async_watch* next;
+} async_watch_t;
+
+// watches stay allocated until the loop ends, events already returned by
+// epoll_wait may still point at them after a case finished
+struct test_async {
+    test_case_t* test_case;
+    int epoll_fd;
+    size_t* pending;
+    uint64_t start;
+    uint64_t deadline;
+    bool done;
+    void* data;
+    void (*cleanup)(void* data);
+    async_watch_t* watches;
+};
+
+void test_async_set_data(test_async_t* async, void* data, void (*cleanup)(void* data)) {
+    if (!async) return;
+    async->data = data;
+    async->cleanup = cleanup;
+}
+
+void* test_async_data(const test_async_t* async) {
+    return async ? async->data : NULL;
+}
+
+#ifdef __linux__
+static uint32_t async_epoll_events(int events) {
+    return ((events & TEST_ASYNC_READ) ? EPOLLIN : 0) | ((events & TEST_ASYNC_WRITE) ? EPOLLOUT : 0);
+}
+#endif
+
+int test_async_watch(test_async_t* async, int fd, int events, test_async_io_func_t callback, void* data) {
+    if (!async || async->done || fd < 0 || !callback) return -1;
+
+#ifdef __linux__
+    async_watch_t* watch = async->watches;
+    while (watch && watch->fd != fd) watch = watch->next;
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = async_epoll_events(events);
+    
+    if (watch) {
+        event.data.ptr = watch;
+        if (epoll_ctl(async->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) return -1;
+    } else {
+        watch = malloc(sizeof(async_watch_t));
+        if (!watch) return -1;
+        event.data.ptr = watch;
+        if (epoll_ctl(async->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(watch);
+            return -1;
+        }
+        watch->async = async;
+        watch->fd = fd;
+        watch->next = async->watches;
+        async->watches = watch;
+    }
+    watch->callback = callback;
+    watch->data = data;
+    return 0;
+#else
+    (void)events;
+    (void)data;
+    return -1;
+#endif
+}
+
+void test_async_unwatch(test_async_t* async, int fd) {
+    if (!async || fd < 0) return;
+    
+    for (async_watch_t* watch = async->watches; watch; watch = watch->next) {
+        if (watch->fd != fd) continue;
+#ifdef __linux__
+        epoll_ctl(async->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+        watch->fd = -1;
+        return;
+    }
+}
+
+static void async_finish(test_async_t* async, test_status_t status) {
+    if (async->done) return;
+    async->done = true;
+    
+    test_case_t* test_case = async->test_case;
+    test_case->duration_ns += monotonic_ns() - async->start;
+    if (test_case_add_result(test_case, status) != 0) {
+        fprintf(stderr, "Warning: Failed to add test result for %s\n", test_case->name);
+    }
+    
+    for (async_watch_t* watch = async->watches; watch; watch = watch->next) {
+        if (watch->fd >= 0) test_async_unwatch(async, watch->fd);
+    }
+    if (async->cleanup) async->cleanup(async->data);
+    (*async->pending)--;
+}
+
+void test_async_done(test_async_t* async, test_status_t status) {
+    if (!async) return;
+    async_finish(async, status);
+}
+
+static void async_timeout(test_async_t* async) {
+    uint64_t timeout_ms = async->test_case->async_timeout_ns / 1000000ULL;
+    async_finish(async, STATUS_RUNTIME_ERROR);
+    
+    char message[64];
+    snprintf(message, sizeof(message), "timed out after %" PRIu64 " ms", timeout_ms);
+    test_diagnostic_t diagnostic = { message, NULL, 0, 0, NULL };
+    test_case_add_diagnostic(async->test_case, async->test_case->result_count - 1, &diagnostic);
+}
+
+static int compare_deadlines(const void* a, const void* b) {
+    const test_async_t* x = *(const test_async_t* const*)a;
+    const test_async_t* y = *(const test_async_t* const*)b;
+    return x->deadline < y->deadline ? -1 : x->deadline > y->deadline;
+}
+
+// starts every case, then multiplexes them all on one epoll instance until
+// each has completed or passed its deadline
+static void run_async_cases(test_case_t* const* cases, size_t count) {
+    if (count == 0) return;
+    
+    test_async_t* asyncs = calloc(count, sizeof(test_async_t));
+    test_async_t** order = malloc(count * sizeof(test_async_t*));
+#ifdef __linux__
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    int epoll_fd = -1;
+#endif
+    if (!asyncs || !order || epoll_fd < 0) {
+        for (size_t i = 0; i < count; i++) {
+            cases[i]->attempts++;
+            test_case_add_result(cases[i], STATUS_BUILD_ERROR);
+        }
+        fprintf(stderr, "Warning: Cannot run async test cases without epoll\n");
+        free(asyncs);
+        free(order);
+        if (epoll_fd >= 0) close(epoll_fd);
+        return;
+    }
+    
+    size_t pending = count;
+    for (size_t i = 0; i < count; i++) {
+        test_async_t* async = &asyncs[i];
+        async->test_case = cases[i];
+        async->epoll_fd = epoll_fd;
+        async->pending = &pending;
+        async->start = monotonic_ns();
+        async->deadline = async->start + cases[i]->async_timeout_ns;
+        order[i] = async;
+        
+        cases[i]->attempts++;
+        cases[i]->async_func(async);
+    }
+    
+    // deadlines are visited in order, finished cases are skipped on the way
+    qsort(order, count, sizeof(test_async_t*), compare_deadlines);
+    size_t next_deadline = 0;
+
+#ifdef __linux__
+    struct epoll_event events[ASYNC_MAX_EVENTS];
+    while (pending > 0) {
+        uint64_t now = monotonic_ns();
+        while (next_deadline < count && (order[next_deadline]->done || order[next_deadline]->deadline <= now)) {
+            if (!order[next_deadline]->done) async_timeout(order[next_deadline]);
+            next_deadline++;
+        }
+        if (pending == 0) break;
+        
+        uint64_t wait_ns = order[next_deadline]->deadline - now;
+        int timeout_ms = wait_ns / 1000000ULL >= INT_MAX ? INT_MAX : (int)((wait_ns + 999999ULL) / 1000000ULL);
+        int ready = epoll_wait(epoll_fd, events, ASYNC_MAX_EVENTS, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        for (int i = 0; i < ready; i++) {
+            async_watch_t* watch = events[i].data.ptr;
+            if (watch->fd < 0 || watch->async->done) continue;
+            
+            int ready_events = ((events[i].events & EPOLLIN) ? TEST_ASYNC_READ : 0) |
+                               ((events[i].events & EPOLLOUT) ? TEST_ASYNC_WRITE : 0) |
+                               ((events[i].events & (EPOLLERR | EPOLLHUP)) ? TEST_ASYNC_ERROR : 0);
+            watch->callback(watch->async, watch->fd, ready_events, watch->data);
+        }
+    }
+#endif
+    
+    // only reached with cases left over if epoll itself failed
+    for (size_t i = 0; i < count; i++) {
+        if (!asyncs[i].done) async_finish(&asyncs[i], STATUS_RUNTIME_ERROR);
+        
+        async_watch_t* watch = asyncs[i].watches;
+        while (watch) {
+            async_watch_t* next = watch->next;
+            free(watch);
+            watch = next;
+        }
+    }
+    
+    close(epoll_fd);
+    free(order);
+    free(asyncs);
+}
+
+void test_runner_add_suite(test_runner_t* runner, test_suite_t* suite) {
+    if (!runner || !suite) return;
+    
+    pthread_mutex_lock(&registration_lock);
+    if (!runner->root_suite) {
+        runner->root_suite = suite;
+    } else {
+        test_suite_t* current = runner->last_suite ? runner->last_suite : runner->root_suite;
+        while (current->next) {
+            current = current->next;
+        }
+        current->next = suite;
+    }
+    runner->last_suite = suite;
+    tree_generation++;
+    pthread_mutex_unlock(&registration_lock);
+}
+
+void test_runner_set_seed(test_runner_t* runner, uint64_t seed) {
+    if (!runner) return;
+    runner->seed = seed;
+}
+
+void test_runner_set_jobs(test_runner_t* runner, int jobs) {
+    if (!runner) return;
+    runner->jobs = jobs > 0 ? jobs : 1;
+}
+
+void test_runner_set_retries(test_runner_t* runner, int retries) {
+    if (!runner) return;
+    runner->retries = retries > 0 ? retries : 0;
+}
+
+void test_runner_set_verbose(test_runner_t* runner, bool verbose) {
+    if (!runner) return;
+    runner->verbose = verbose;
+}
+
+void test_runner_set_color(test_runner_t* runner, bool color) {
+    if (!runner) return;
+    runner->color = color;
+}
+
+void test_runner_set_run_length(test_runner_t* runner, int threshold) {
+    if (!runner) return;
+    runner->run_length = threshold > 1 ? threshold : 0;
+}
+
+void test_runner_set_max_depth(test_runner_t* runner, int depth) {
+    if (!runner) return;
+    runner->max_depth = depth > 0 ? depth : 0;
+}
+
+void test_runner_set_failures_only(test_runner_t* runner, bool failures_only) {
+    if (!runner) return;
+    runner->failures_only = failures_only;
+}
+
+void test_runner_set_collapse(test_runner_t* runner, bool collapse) {
+    if (!runner) return;
+    runner->collapse = collapse;
+}
+
+void test_runner_set_capture(test_runner_t* runner, bool capture) {
+    if (!runner) return;
+    runner->capture = capture;
+}
+
+void test_runner_set_timing(test_runner_t* runner, bool timing) {
+    if (!runner) return;
+    runner->timing = timing;
+}
+
+int test_runner_set_shard(test_runner_t* runner, int index, int count) {
+    if (!runner || count < 1 || index < 0 || index >= count) return -1;
+    runner->shard_index = index;
+    runner->shard_count = count;
+    return 0;
+}
+
+static int replace_path(char** target, const char* path) {
+    char* copy = NULL;
+    if (path) {
+        copy = strdup(path);
+        if (!copy) return -1;
+    }
+    
+    free(*target);
+    *target = copy;
+    return 0;
+}
+
+int test_runner_set_cache(test_runner_t* runner, const char* path) {
+    if (!runner) return -1;
+    return replace_path(&runner->cache_path, path);
+}
+
+int test_runner_set_log(test_runner_t* runner, const char* path) {
+    if (!runner) return -1;
+    return replace_path(&runner->log_path, path);
+}
+
+int test_runner_set_tap(test_runner_t* runner, const char* path) {
+    if (!runner) return -1;
+    return replace_path(&runner->tap_path, path);
+}
+
+// status histogram kernels over the byte column of the result store, picked
+// once by what the CPU supports; out-of-range statuses are counted nowhere
+typedef void (*count_statuses_func_t)(const uint8_t* statuses, size_t count, size_t* counts);
+
+// four sets of buckets, so runs of the same status do not serialize on one
+static void count_statuses_scalar(const uint8_t* statuses, size_t count, size_t* counts) {
+    size_t buckets[4][8] = { { 0 } };
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        buckets[0][status_index(statuses[i])]++;
+        buckets[1][status_index(statuses[i + 1])]++;
+        buckets[2][status_index(statuses[i + 2])]++;
+        buckets[3][status_index(statuses[i + 3])]++;
+    }
+    for (; i < count; i++) {
+        buckets[0][status_index(statuses[i])]++;
+    }
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        counts[k] += buckets[0][k] + buckets[1][k] + buckets[2][k] + buckets[3][k];
+    }
+}
+
+#ifdef STATUS_HISTOGRAM_X86
+// each kind keeps one byte counter per lane: a compare yields 0xFF (-1) for
+// a match, subtracting it counts up; after 255 vectors the lanes are summed
+// with sad against zero before they can wrap
+#define HISTOGRAM_FLUSH 255
+
+__attribute__((target("sse2")))
+static void count_statuses_sse2(const uint8_t* statuses, size_t count, size_t* counts) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i kinds[STATUS_KIND_COUNT];
+    __m128i totals[STATUS_KIND_COUNT];
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        kinds[k] = _mm_set1_epi8((char)k);
+        totals[k] = zero;
+    }
+    
+    size_t i = 0;
+    while (count - i >= 16) {
+        size_t blocks = (count - i) / 16;
+        if (blocks > HISTOGRAM_FLUSH) blocks = HISTOGRAM_FLUSH;
+        
+        __m128i lanes[STATUS_KIND_COUNT];
+        for (int k = 0; k < STATUS_KIND_COUNT; k++) lanes[k] = zero;
+        for (size_t b = 0; b < blocks; b++, i += 16) {
+            __m128i data = _mm_loadu_si128((const __m128i*)(statuses + i));
+            for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+                lanes[k] = _mm_sub_epi8(lanes[k], _mm_cmpeq_epi8(data, kinds[k]));
+            }
+        }
+        for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+            totals[k] = _mm_add_epi64(totals[k], _mm_sad_epu8(lanes[k], zero));
+        }
+    }
+    
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        uint64_t sums[2];
+        _mm_storeu_si128((__m128i*)sums, totals[k]);
+        counts[k] += (size_t)(sums[0] + sums[1]);
+    }
+    count_statuses_scalar(statuses + i, count - i, counts);
+}
+
+__attribute__((target("avx2")))
+static void count_statuses_avx2(const uint8_t* statuses, size_t count, size_t* counts) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i kinds[STATUS_KIND_COUNT];
+    __m256i totals[STATUS_KIND_COUNT];
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        kinds[k] = _mm256_set1_epi8((char)k);
+        totals[k] = zero;
+    }
+    
+    size_t i = 0;
+    while (count - i >= 32) {
+        size_t blocks = (count - i) / 32;
+        if (blocks > HISTOGRAM_FLUSH) blocks = HISTOGRAM_FLUSH;
+        
+        __m256i lanes[STATUS_KIND_COUNT];
+        for (int k = 0; k < STATUS_KIND_COUNT; k++) lanes[k] = zero;
+        for (size_t b = 0; b < blocks; b++, i += 32) {
+            __m256i data = _mm256_loadu_si256((const __m256i*)(statuses + i));
+            for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+                lanes[k] = _mm256_sub_epi8(lanes[k], _mm256_cmpeq_epi8(data, kinds[k]));
+            }
+        }
+        for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+            totals[k] = _mm256_add_epi64(totals[k], _mm256_sad_epu8(lanes[k], zero));
+        }
+    }
+    
+    for (int k = 0; k < STATUS_KIND_COUNT; k++) {
+        uint64_t sums[4];
+        _mm256_storeu_si256((__m256i*)sums, totals[k]);
+        counts[k] += (size_t)(sums[0] + sums[1] + sums[2] + sums[3]);
+    }
+    count_statuses_scalar(statuses + i, count - i, counts);
+}
+#endif
+
+static count_statuses_func_t select_count_statuses(void) {
+#ifdef STATUS_HISTOGRAM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return count_statuses_avx2;
+    if (__builtin_cpu_supports("sse2")) return count_statuses_sse2;
+#endif
+    return count_statuses_scalar;
+}
+
+// adds the kinds found in statuses to counts[STATUS_KIND_COUNT]
+static void count_statuses(const uint8_t* statuses, size_t count, size_t counts[STATUS_KIND_COUNT]) {
+    static count_statuses_func_t kernel = NULL;
+    count_statuses_func_t func = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (!func) {
+        func = select_count_statuses();
+        __atomic_store_n(&kernel, func, __ATOMIC_RELAXED);
+    }
+    func(statuses, count, counts);
+}
+
+// runner-wide result columns: the status of every result as a byte, and per
+// case id the case and its duration. A case's results are appended as one
+// span when the case is done, and a case recorded again leaves its old span
+// dead until the store is compacted in DFS order.
+typedef struct result_store result_store_t;
+
+struct result_store {
+    uint8_t* statuses;
+    size_t count;
+    size_t capacity;
+    size_t live;            // results in current spans
+    test_case_t** cases;    // by case id, store_id - 1
+    uint64_t* durations;
+    size_t case_count;
+    size_t case_capacity;
+};
+
+static result_store_t* runner_store(test_runner_t* runner) {
+    if (!runner->store) runner->store = calloc(1, sizeof(result_store_t));
+    return runner->store;
+}
+
+static void free_result_store(test_runner_t* runner) {
+    result_store_t* store = runner->store;
+    if (!store) return;
+    
+    free(store->statuses);
+    free(store->cases);
+    free(store->durations);
+    free(store);
+    runner->store = NULL;
+}
+
+static bool store_has_case(const result_store_t* store, const test_case_t* test_case) {
+    return test_case->store_id > 0 && test_case->store_id <= store->case_count &&
+           store->cases[test_case->store_id - 1] == test_case;
+}
+
+// results recorded after the span was stored make it stale
+static bool store_has_span(const result_store_t* store, const test_case_t* test_case) {
+    return store && store_has_case(store, test_case) &&
+           test_case->store_count == test_case->result_count;
+}
+
+static int store_append(result_store_t* store, test_case_t* test_case) {
+    bool known = store_has_case(store, test_case);
+    if (!known && store->case_count >= store->case_capacity) {
+        size_t new_capacity = store->case_capacity == 0 ? 256 : store->case_capacity * 2;
+        test_case_t** new_cases = realloc(store->cases, new_capacity * sizeof(test_case_t*));
+        if (!new_cases) return -1;
+        store->cases = new_cases;
+        uint64_t* new_durations = realloc(store->durations, new_capacity * sizeof(uint64_t));
+        if (!new_durations) return -1;
+        store->durations = new_durations;
+        store->case_capacity = new_capacity;
+    }
+    
+    size_t length = (size_t)test_case->result_count;
+    if (store->count + length > store->capacity) {
+        size_t new_capacity = store->capacity == 0 ? 4096 : store->capacity * 2;
+        while (new_capacity < store->count + length) new_capacity *= 2;
+        uint8_t* new_statuses = realloc(store->statuses, new_capacity);
+        if (!new_statuses) return -1;
+        store->statuses = new_statuses;
+        store->capacity = new_capacity;
+    }
+    
+    // the old span is dead, unless compaction already dropped it
+    if (known) {
+        size_t dead = (size_t)test_case->store_count;
+        store->live -= dead < store->live ? dead : store->live;
+    } else {
+        store->cases[store->case_count++] = test_case;
+        test_case->store_id = store->case_count;
+    }
+    
+    uint8_t* column = store->statuses + store->count;
+    for (size_t i = 0; i < length; i++) {
+        column[i] = (uint8_t)status_index(test_case->results[i]);
+    }
+    test_case->store_offset = store->count;
+    test_case->store_count = test_case->result_count;
+    store->durations[test_case->store_id - 1] = test_case->duration_ns;
+    store->count += length;
+    store->live += length;
+    return 0;
+}
+
+// cases given results outside a run, e.g. by loading a log, get their spans
+// here; a case whose append fails is counted from its results array
+static void store_sync_suites(result_store_t* store, test_suite_t* suite) {
+    for (; suite; suite = suite->next) {
+        for (test_case_t* test_case = suite->test_cases; test_case; test_case = test_case->next) {
+            if (store_has_span(store, test_case)) {
+                store->durations[test_case->store_id - 1] = test_case->duration_ns;
+            } else {
+                store_append(store, test_case);
+            }
+        }
+        store_sync_suites(store, suite->child_suites);
+    }
+}
+
+static void store_copy_spans(const result_store_t* store, uint8_t* statuses, size_t* count,
+                             test_suite_t* suite) {
+    for (; suite; suite = suite->next) {
+        for (test_case_t* test_case = suite->test_cases; test_case; test_case = test_case->next) {
+            if (!store_has_span(store, test_case)) {
+                test_case->store_offset = 0;
+                test_case->store_count = 0;
+                continue;
+            }
+            
+            memcpy(statuses + *count, store->statuses + test_case->store_offset,
+                   (size_t)test_case->store_count);
+            test_case->store_offset = *count;
+            *count += (size_t)test_case->store_count;
+        }
+        store_copy_spans(store, statuses, count, suite->child_suites);
+    }
+}
+
+// once dead spans outweigh live ones, the live ones are copied out in DFS
+// order, which also puts every suite's cases back to back
+static void compact_result_store(result_store_t* store, test_suite_t* roots) {
+    uint8_t* statuses = malloc(store->live > 0 ? store->live : 1);
+    if (!statuses) return;
+    
+    size_t count = 0;
+    store_copy_spans(store, statuses, &count, roots);
+    free(store->statuses);
+    store->statuses = statuses;
+    store->count = count;
+    store->capacity = store->live > 0 ? store->live : 1;
+    store->live = count;
+}
+
+static result_store_t* sync_result_store(test_runner_t* runner) {
+    result_store_t* store = runner_store(runner);
+    if (!store) return NULL;
+    
+    store_sync_suites(store, runner->root_suite);
+    if (store->count - store->live > store->live) compact_result_store(store, runner->root_suite);
+    return store;
+}
+
+int test_runner_result_columns(test_runner_t* runner, test_result_columns_t* columns) {
+    if (!runner || !columns) return -1;
+    
+    result_store_t* store = sync_result_store(runner);
+    if (!store) return -1;
+    
+    columns->statuses = store->statuses;
+    columns->result_count = store->count;
+    columns->cases = store->cases;
+    columns->durations = store->durations;
+    columns->case_count = store->case_count;
+    return 0;
+}
+
+static void add_stats(test_stats_t* stats, const test_stats_t* other) {
+    stats->success_count += other->success_count;
+    stats->unexpected_output_count += other->unexpected_output_count;
+    stats->expected_build_error_count += other->expected_build_error_count;
+    stats->build_error_count += other->build_error_count;
+    stats->expected_runtime_error_count += other->expected_runtime_error_count;
+    stats->runtime_error_count += other->runtime_error_count;
+    stats->flaky_count += other->flaky_count;
+}
+
+// short runs of the column are counted in place, long ones, e.g. the cases
+// of a suite that ran back to back, go through the histogram kernel
+#define HISTOGRAM_MIN_RESULTS 32
+
+static void count_span(const uint8_t* statuses, size_t count, size_t counts[STATUS_INVALID + 1]) {
+    if (count >= HISTOGRAM_MIN_RESULTS) {
+        count_statuses(statuses, count, counts);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        counts[status_index(statuses[i])]++;
+    }
+}
+
+// adjacent spans of the store are gathered into one run before counting
+static void calculate_suite_stats(const result_store_t* store, test_suite_t* suite) {
+    if (!suite) return;
+    
+    memset(&suite->stats, 0, sizeof(test_stats_t));
+    
+    size_t counts[STATUS_INVALID + 1] = { 0 };
+    size_t begin = 0;
+    size_t end = 0;
+    for (test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        if (store_has_span(store, current_case)) {
+            if (current_case->store_offset != end) {
+                if (end > begin) count_span(store->statuses + begin, end - begin, counts);
+                begin = current_case->store_offset;
+            }
+            end = current_case->store_offset + (size_t)current_case->store_count;
+        } else {
+            for (int i = 0; i < current_case->result_count; i++) {
+                counts[status_index(current_case->results[i])]++;
+            }
+        }
+        suite->stats.flaky_count += current_case->flaky_count;
+    }
+    if (end > begin) count_span(store->statuses + begin, end - begin, counts);
+    
+    suite->stats.success_count = (int)counts[STATUS_SUCCESS];
+    suite->stats.unexpected_output_count = (int)counts[STATUS_UNEXPECTED_OUTPUT];
+    suite->stats.expected_build_error_count = (int)counts[STATUS_EXPECTED_BUILD_ERROR];
+    suite->stats.build_error_count = (int)counts[STATUS_BUILD_ERROR];
+    suite->stats.expected_runtime_error_count = (int)counts[STATUS_EXPECTED_RUNTIME_ERROR];
+    suite->stats.runtime_error_count = (int)counts[STATUS_RUNTIME_ERROR];
+    
+    for (test_suite_t* child = suite->child_suites; child; child = child->next) {
+        calculate_suite_stats(store, child);
+        add_stats(&suite->stats, &child->stats);
+    }
+}
+
+void print_legend(void) {
+    printf("%sK%s - success                %sK%s - unexpected output\n",
+           palette->green, palette->reset, palette->yellow, palette->reset);
+    printf("%sB%s - expected build error   %sB%s - build error\n",
+           palette->gray, palette->reset, palette->red, palette->reset);
+    printf("%sR%s - expected runtime error %sR%s - runtime error\n",
+           palette->gray, palette->reset, palette->red, palette->reset);
+    printf("\n");
+}
+
+static void print_stats(const test_stats_t* stats) {
+    printf("K: %s%2d%s/%s%d%s  B: %s%2d%s/%s%d%s  R: %s%2d%s/%s%d%s",
+           palette->green, stats->success_count, palette->reset,
+           palette->yellow, stats->unexpected_output_count, palette->reset,
+           palette->gray, stats->expected_build_error_count, palette->reset,
+           palette->red, stats->build_error_count, palette->reset,
+           palette->gray, stats->expected_runtime_error_count, palette->reset,
+           palette->red, stats->runtime_error_count, palette->reset);
+    if (stats->flaky_count > 0) {
+        printf("  F: %s%d%s", palette->yellow, stats->flaky_count, palette->reset);
+    }
+}
+
+// runs of at least run_length equal results are printed once, e.g. "K×4096"
+static void print_results(const test_case_t* test_case) {
+    int i = 0;
+    while (i < test_case->result_count) {
+        unsigned index = status_index(test_case->results[i]);
+        int end = i + 1;
+        while (end < test_case->result_count && status_index(test_case->results[end]) == index) end++;
+        
+        if (run_length > 0 && end - i >= run_length) {
+            printf("%s%c×%d%s ", palette->colors[index], get_status_char(test_case->results[i]),
+                   end - i, palette->reset);
+        } else {
+            for (int j = i; j < end; j++) fputs(palette->glyphs[index], stdout);
+        }
+        i = end;
+    }
+}
+
+// how the retries went, or the flake rate once several runs were merged
+static void print_flaky_note(const test_case_t* test_case) {
+    if (test_case->attempts > 1) {
+        if (case_failed(test_case)) {
+            printf("%s(failed %d attempts)%s", palette->red, test_case->attempts, palette->reset);
+        } else {
+            printf("%s(flaky, passed on attempt %d)%s", palette->yellow, test_case->attempts, palette->reset);
+        }
+    } else if (test_case->flaky_count > 0) {
+        printf("%s(flaky in %d of %d runs)%s", palette->yellow, test_case->flaky_count,
+               test_case->run_count, palette->reset);
+    }
+}
+
+// one line under a case; bar continues the case's branch, is_last ends the details
+static void print_detail(const char* prefix, const char* bar, bool is_last, const char* text) {
+    printf("%s%s %s─%s\n", prefix, bar, is_last ? "└" : "├", text);
+}
+
+// captured output, one dimmed line per line, indented under its detail; the
+// last OUTPUT_LINES lines unless verbose
+static void print_output(const char* prefix, const char* bar, bool is_last, const char* output,
+                         bool verbose) {
+    const char* line = output;
+    if (!verbose) {
+        int lines = 0;
+        const char* end = output + strlen(output);
+        if (end > output && end[-1] == '\n') end--;
+        while (end > output && lines < OUTPUT_LINES) {
+            if (*--end == '\n') lines++;
+        }
+        if (end > output) {
+            int skipped = 1;
+            for (const char* c = output; c < end; c++) {
+                if (*c == '\n') skipped++;
+            }
+            bool cut = strncmp(output, "...\n", 4) == 0;
+            printf("%s%s %s  %s(%d%s earlier lines)%s\n", prefix, bar, is_last ? " " : "│",
+                   palette->gray, skipped - cut, cut ? "+" : "", palette->reset);
+            line = end + 1;
+        }
+    }
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        int length = end ? (int)(end - line) : (int)strlen(line);
+        printf("%s%s %s  %s%.*s%s\n", prefix, bar, is_last ? " " : "│",
+               palette->gray, length, line, palette->reset);
+        if (!end) break;
+        line = end + 1;
+    }
+}
+
+// the case's report, then its failure details: only the first unless verbose;
+// parameterized cases show theirs on the row lines instead
+static void print_case_details(test_case_t* test_case, const char* prefix, const char* bar,
+                               bool verbose, bool more) {
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    int shown = 0;
+    if (diagnostics && test_case->kind != TEST_KIND_PARAM) {
+        shown = verbose || diagnostics->count == 0 ? diagnostics->count : 1;
+    }
+    
+    if (test_case->report) {
+        print_detail(prefix, bar, shown == 0 && !more, test_case->report);
+    }
+    
+    char text[REPORT_LIMIT];
+    for (int i = 0; i < shown; i++) {
+        diagnostic_record_t* record = &diagnostics->records[i];
+        const test_diagnostic_t* diagnostic = resolve_diagnostic(diagnostics, record);
+        
+        int length = 0;
+        if (test_case->result_count > 1) {
+            length = snprintf(text, sizeof(text), "#%d ", record->result);
+        }
+        format_diagnostic(diagnostic, text + length, sizeof(text) - length);
+        if (shown < diagnostics->count) {
+            length = strlen(text);
+            snprintf(text + length, sizeof(text) - length, " (+%d more)", diagnostics->count - shown);
+        }
+        
+        bool is_last = i == shown - 1 && !more;
+        print_detail(prefix, bar, is_last, text[0] ? text : "output:");
+        if (diagnostic->output) print_output(prefix, bar, is_last, diagnostic->output, verbose);
+    }
+}
+
+// how the tree is printed, from the runner's settings; the prefix grows by
+// one "│ " or "  " per level and is cut back when a suite is done
+typedef struct {
+    int max_depth;
+    bool failures_only;
+    bool collapse;
+    bool verbose;
+    char* prefix;
+    size_t length;
+    size_t capacity;
+} tree_render_t;
+
+static int render_push(tree_render_t* render, bool is_last) {
+    const char* segment = is_last ? "  " : "│ ";
+    size_t segment_length = strlen(segment);
+    if (render->length + segment_length + 1 > render->capacity) {
+        size_t new_capacity = render->capacity * 2;
+        while (new_capacity < render->length + segment_length + 1) new_capacity *= 2;
+        char* new_prefix = realloc(render->prefix, new_capacity);
+        if (!new_prefix) return -1;
+        render->prefix = new_prefix;
+        render->capacity = new_capacity;
+    }
+    memcpy(render->prefix + render->length, segment, segment_length + 1);
+    render->length += segment_length;
+    return 0;
+}
+
+static void render_pop(tree_render_t* render, size_t length) {
+    render->length = length;
+    render->prefix[length] = '\0';
+}
+
+// expected errors are fine, only unexpected output and errors are not
+static bool stats_all_green(const test_stats_t* stats) {
+    return stats->unexpected_output_count == 0 && stats->build_error_count == 0 &&
+           stats->runtime_error_count == 0;
+}
+
+static bool stats_empty(const test_stats_t* stats) {
+    return stats->success_count == 0 && stats->expected_build_error_count == 0 &&
+           stats->expected_runtime_error_count == 0 && stats_all_green(stats);
+}
+
+// suites hidden by failures_only are known from their stats, never walked
+static test_suite_t* next_shown_suite(const tree_render_t* render, test_suite_t* suite) {
+    while (suite && render->failures_only && stats_all_green(&suite->stats)) suite = suite->next;
+    return suite;
+}
+
+// cases left out by the tag filter are not shown, passing ones only on request
+static test_case_t* next_shown_case(const tree_render_t* render, test_case_t* test_case) {
+    while (test_case && (test_case->filtered || (render->failures_only && !case_failed(test_case)))) {
+        test_case = test_case->next;
+    }
+    return test_case;
+}
+
+static void print_tree_node(tree_render_t* render, test_suite_t* suite, bool is_last, int depth) {
+    if (!suite) return;
+    
+    bool verbose = render->verbose;
+    
+    // current suite
+    printf("%s%s─%s", render->prefix, is_last ? "└" : "├", suite->name);
+    
+    // padding and stats
+    int name_len = strlen(suite->name);
+    int padding = 50 - (int)render->length - name_len - 2; // 2 for tree chars
+    if (padding < 1) padding = 1;
+    
+    for (int i = 0; i < padding; i++) {
+        printf(" ");
+    }
+    
+    print_stats(&suite->stats);
+    
+    // the summary line stands in for the whole subtree, which is not walked
+    bool collapsed = (render->collapse && stats_all_green(&suite->stats)) ||
+                     (render->max_depth > 0 && depth + 1 >= render->max_depth);
+    if (collapsed && !stats_empty(&suite->stats)) {
+        printf("  %s(collapsed)%s", palette->gray, palette->reset);
+    }
+    printf("\n");
+    if (collapsed) return;
+    
+    test_case_t* first_case = next_shown_case(render, suite->test_cases);
+    test_suite_t* first_suite = next_shown_suite(render, suite->child_suites);
+    
+    size_t length = render->length;
+    if (render_push(render, is_last) != 0) return;
+    
+    // child suites, then cases, so only a suite with no cases after it is last
+    test_suite_t* current_suite = first_suite;
+    while (current_suite) {
+        test_suite_t* next_suite = next_shown_suite(render, current_suite->next);
+        bool is_last_suite = (next_suite == NULL && first_case == NULL);
+        print_tree_node(render, current_suite, is_last_suite, depth + 1);
+        current_suite = next_suite;
+    }
+    
+    const char* new_prefix = render->prefix;
+    test_case_t* current_case = first_case;
+    while (current_case) {
+        test_case_t* next_case = next_shown_case(render, current_case->next);
+        bool is_last_case = (next_case == NULL);
+        const char* bar = is_last_case ? " " : "│";
+        
+        printf("%s%s─%s: ", new_prefix, is_last_case ? "└" : "├", current_case->name);
+        print_results(current_case);
+        print_flaky_note(current_case);
+        printf("\n");
+        
+        // only failing rows get a line of their own
+        int rows = 0;
+        int next_failed = 0;
+        if (current_case->kind == TEST_KIND_PARAM) {
+            rows = current_case->result_count < current_case->param_count ?
+                   current_case->result_count : current_case->param_count;
+            while (next_failed < rows && !status_is_failure(current_case->results[next_failed])) {
+                next_failed++;
+            }
+        }
+        
+        print_case_details(current_case, new_prefix, bar, verbose, next_failed < rows);
+        
+        char row_name[128];
+        char text[REPORT_LIMIT];
+        while (next_failed < rows) {
+            int i = next_failed++;
+            while (next_failed < rows && !status_is_failure(current_case->results[next_failed])) {
+                next_failed++;
+            }
+            
+            diagnostic_record_t* record = find_diagnostic(current_case->diagnostics, i);
+            const test_diagnostic_t* diagnostic = NULL;
+            text[0] = '\0';
+            if (record) {
+                diagnostic = resolve_diagnostic(current_case->diagnostics, record);
+                text[0] = ' ';
+                format_diagnostic(diagnostic, text + 1, sizeof(text) - 1);
+            }
+            
+            bool is_last_row = next_failed >= rows;
+            format_param_row_name(current_case, i, row_name, sizeof(row_name));
+            printf("%s%s %s─%s: %s%c%s%s\n", new_prefix, bar,
+                   is_last_row ? "└" : "├", row_name,
+                   get_status_color(current_case->results[i]),
+                   get_status_char(current_case->results[i]), palette->reset, text);
+            if (diagnostic && diagnostic->output) {
+                print_output(new_prefix, bar, is_last_row, diagnostic->output, verbose);
+            }
+        }
+        
+        current_case = next_case;
+    }
+    
+    render_pop(render, length);
+}
+
+void print_test_results(test_runner_t* runner) {
+    if (!runner || !runner->root_suite) return;
+    
+    select_rendering(runner);
+    print_legend();
+    
+    // stats calc
+    memset(&runner->global_stats, 0, sizeof(test_stats_t));
+    const result_store_t* store = sync_result_store(runner);
+    test_suite_t* current = runner->root_suite;
+    while (current) {
+        calculate_suite_stats(store, current);
+        add_stats(&runner->global_stats, &current->stats);
+        current = current->next;
+    }
+    
+    tree_render_t render;
+    render.max_depth = runner->max_depth;
+    render.failures_only = runner->failures_only;
+    render.collapse = runner->collapse;
+    render.verbose = runner->verbose;
+    render.length = 0;
+    render.capacity = 64;
+    render.prefix = malloc(render.capacity);
+    if (!render.prefix) return;
+    render.prefix[0] = '\0';
+    
+    current = next_shown_suite(&render, runner->root_suite);
+    while (current) {
+        test_suite_t* next = next_shown_suite(&render, current->next);
+        print_tree_node(&render, current, next == NULL, 0);
+        current = next;
+    }
+    free(render.prefix);
+}
+
+#define CACHE_MAGIC 0x43525455u // "UTRC"
+#define CACHE_VERSION 1
+#define CACHE_INITIAL_SLOTS 1024
+#define CACHE_TOMBSTONE 0xFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t used;
+} cache_header_t;
+
+typedef struct {
+    uint64_t key;
+    uint32_t result_count;
+    uint8_t status;
+    uint8_t reserved[3];
+} cache_slot_t;
+
+// open-addressing table living directly in a shared file mapping
+typedef struct result_cache result_cache_t;
+
+struct result_cache {
+    int fd;
+    cache_header_t* header;
+    cache_slot_t* slots;
+    size_t mapped_size;
+    uint64_t binary_hash;
+    int hits;
+    int executed;
+};
+
+static size_t cache_file_size(uint64_t capacity) {
+    return sizeof(cache_header_t) + capacity * sizeof(cache_slot_t);
+}
+
+static int cache_map(result_cache_t* cache, uint64_t capacity) {
+    size_t size = cache_file_size(capacity);
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (mapping == MAP_FAILED) return -1;
+    
+    cache->header = mapping;
+    cache->slots = (cache_slot_t*)((char*)mapping + sizeof(cache_header_t));
+    cache->mapped_size = size;
+    return 0;
+}
+
+static void cache_unmap(result_cache_t* cache) {
+    if (cache->header) munmap(cache->header, cache->mapped_size);
+    cache->header = NULL;
+    cache->slots = NULL;
+}
+
+static int cache_reset(result_cache_t* cache, uint64_t capacity) {
+    cache_unmap(cache);
+    
+    // truncating to zero first leaves every slot empty
+    if (ftruncate(cache->fd, 0) != 0 || ftruncate(cache->fd, cache_file_size(capacity)) != 0) {
+        return -1;
+    }
+    if (cache_map(cache, capacity) != 0) return -1;
+    
+    cache->header->magic = CACHE_MAGIC;
+    cache->header->version = CACHE_VERSION;
+    cache->header->capacity = capacity;
+    cache->header->used = 0;
+    return 0;
+}
+
+static cache_slot_t* cache_find(result_cache_t* cache, uint64_t key, bool for_insert) {
+    uint64_t mask = cache->header->capacity - 1;
+    cache_slot_t* tombstone = NULL;
+    for (uint64_t i = key & mask;; i = (i + 1) & mask) {
+        cache_slot_t* slot = &cache->slots[i];
+        if (slot->key == 0) {
+            if (!for_insert) return NULL;
+            return tombstone ? tombstone : slot;
+        }
+        if (slot->key == key && slot->status != CACHE_TOMBSTONE) return slot;
+        if (slot->status == CACHE_TOMBSTONE && !tombstone) tombstone = slot;
+    }
+}
+
+static int cache_grow(result_cache_t* cache) {
+    uint64_t capacity = cache->header->capacity;
+    cache_slot_t* old_slots = malloc(capacity * sizeof(cache_slot_t));
+    if (!old_slots) return -1;
+    memcpy(old_slots, cache->slots, capacity * sizeof(cache_slot_t));
+    
+    if (cache_reset(cache, capacity * 2) != 0) {
+        free(old_slots);
+        return -1;
+    }
+    
+    // tombstones are dropped while rehashing
+    for (uint64_t i = 0; i < capacity; i++) {
+        if (old_slots[i].key == 0 || old_slots[i].status == CACHE_TOMBSTONE) continue;
+        *cache_find(cache, old_slots[i].key, true) = old_slots[i];
+        cache->header->used++;
+    }
+    free(old_slots);
+    return 0;
+}
+
+static void cache_store(result_cache_t* cache, uint64_t key, test_status_t status, int count) {
+    if ((cache->header->used + 1) * 2 > cache->header->capacity && cache_grow(cache) != 0) {
+        return;
+    }
+    
+    cache_slot_t* slot = cache_find(cache, key, true);
+    if (slot->key == 0) cache->header->used++;
+    slot->key = key;
+    slot->result_count = (uint32_t)count;
+    slot->status = (uint8_t)status;
+}
+
+static void cache_forget(result_cache_t* cache, uint64_t key) {
+    cache_slot_t* slot = cache_find(cache, key, false);
+    if (slot) slot->status = CACHE_TOMBSTONE;
+}
+
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = data;
+    uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15ULL);
+    
+    // eight bytes per step, this runs over whole executables
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+        bytes += 8;
+        size -= 8;
+    }
+    while (size--) {
+        hash = (hash ^ *bytes++) * 0x100000001B3ULL;
+    }
+    return splitmix64(hash);
+}
+
+// hashes the loaded code and data sections so relinking with identical code
+// keeps the cache warm, falls back to the whole file for non-ELF64 objects
+static uint64_t hash_object_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    
+    size_t size = (size_t)info.st_size;
+    const unsigned char* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return 0;
+    
+    uint64_t hash = 0;
+#ifdef __linux__
+    const Elf64_Ehdr* elf = (const Elf64_Ehdr*)image;
+    if (size >= sizeof(Elf64_Ehdr) && memcmp(elf->e_ident, ELFMAG, SELFMAG) == 0 &&
+        elf->e_ident[EI_CLASS] == ELFCLASS64 && elf->e_shentsize == sizeof(Elf64_Shdr) &&
+        elf->e_shoff + (uint64_t)elf->e_shnum * sizeof(Elf64_Shdr) <= size &&
+        elf->e_shstrndx < elf->e_shnum) {
+        const Elf64_Shdr* sections = (const Elf64_Shdr*)(image + elf->e_shoff);
+        const Elf64_Shdr* names = &sections[elf->e_shstrndx];
+        
+        for (int i = 0; i < elf->e_shnum; i++) {
+            const Elf64_Shdr* section = &sections[i];
+            if (section->sh_type != SHT_PROGBITS || !(section->sh_flags & SHF_ALLOC) ||
+                section->sh_offset + section->sh_size > size || section->sh_name >= names->sh_size) {
+                continue;
+            }
+            
+            const char* name = (const char*)image + names->sh_offset + section->sh_name;
+            if (strcmp(name, ".text") == 0 || strcmp(name, ".rodata") == 0 || strcmp(name, ".data") == 0) {
+                hash = hash_bytes(image + section->sh_offset, section->sh_size, hash);
+            }
+        }
+    }
+#endif
+    if (hash == 0) hash = hash_bytes(image, size, 0);
+    
+    munmap((void*)image, size);
+    return hash;
+}
+
+// every object with code mapped into the process, i.e. the test binary, the
+// libraries it links and modules from test_runner_load_dir, so cases living
+// in any of them get new keys when it changes; summed since load addresses
+// and therefore the order of the maps differ between runs
+static uint64_t hash_test_binary(void) {
+#ifdef __linux__
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (maps) {
+        uint64_t hash = 0;
+        char line[PATH_MAX + 128];
+        char previous[PATH_MAX] = "";
+        while (fgets(line, sizeof(line), maps)) {
+            char permissions[8];
+            int offset = 0;
+            if (sscanf(line, "%*s %7s %*s %*s %*s %n", permissions, &offset) != 1 || offset == 0 ||
+                permissions[2] != 'x') {
+                continue;
+            }
+            
+            char* path = line + offset;
+            path[strcspn(path, "\n")] = '\0';
+            if (path[0] != '/' || strcmp(path, previous) == 0) continue;
+            snprintf(previous, sizeof(previous), "%s", path);
+            
+            uint64_t object = hash_object_file(path);
+            if (object != 0) hash += splitmix64(object);
+        }
+        fclose(maps);
+        if (hash != 0) return hash;
+    }
+#endif
+    return hash_object_file("/proc/self/exe");
+}
+
+// concurrent runs share the file, each lookup or record batch takes the
+// lock for as long as it touches the table
+static int cache_lock(result_cache_t* cache, short type) {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    return fcntl(cache->fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &lock);
+}
+
+// under the lock: another run may have grown or reset the file since it was
+// mapped, an unusable file starts over empty
+static int cache_attach(result_cache_t* cache) {
+    struct stat info;
+    if (fstat(cache->fd, &info) == 0 && (size_t)info.st_size >= sizeof(cache_header_t)) {
+        cache_header_t header;
+        if (pread(cache->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            header.magic == CACHE_MAGIC && header.version == CACHE_VERSION &&
+            header.capacity >= CACHE_INITIAL_SLOTS && (header.capacity & (header.capacity - 1)) == 0 &&
+            (uint64_t)info.st_size == cache_file_size(header.capacity)) {
+            if (cache->header && cache->mapped_size == (size_t)info.st_size) return 0;
+            cache_unmap(cache);
+            if (cache_map(cache, header.capacity) == 0) return 0;
+        }
+    }
+    return cache_reset(cache, CACHE_INITIAL_SLOTS);
+}
+
+// takes the lock and maps the file as it is now; on failure the cache is
+// left alone for this batch
+static int cache_acquire(result_cache_t* cache) {
+    if (cache_lock(cache, F_WRLCK) != 0) return -1;
+    if (cache_attach(cache) != 0) {
+        cache_lock(cache, F_UNLCK);
+        return -1;
+    }
+    return 0;
+}
+
+static void cache_release(result_cache_t* cache) {
+    cache_lock(cache, F_UNLCK);
+}
+
+static result_cache_t* cache_open(const char* path) {
+    result_cache_t* cache = calloc(1, sizeof(result_cache_t));
+    if (!cache) return NULL;
+    
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) {
+        free(cache);
+        return NULL;
+    }
+    
+    // a file that cannot be locked or mapped disables the cache
+    if (cache_acquire(cache) != 0) {
+        cache_unmap(cache);
+        close(cache->fd);
+        free(cache);
+        return NULL;
+    }
+    cache_release(cache);
+    
+    cache->binary_hash = hash_test_binary();
+    return cache;
+}
+
+static void cache_close(result_cache_t* cache) {
+    if (!cache) return;
+    cache_unmap(cache);
+    close(cache->fd);
+    free(cache);
+}
+
+static uint64_t cache_key(const result_cache_t* cache, const test_case_t* test_case, uint64_t path_hash) {
+    uint64_t version = test_case->version ? test_case->version : cache->binary_hash;
+    uint64_t key = splitmix64(path_hash ^ splitmix64(version));
+    return key != 0 ? key : 1;
+}
+
+// property and fuzz inputs are not part of the key, so only deterministic
+// cases are replayed
+static bool cache_replay(result_cache_t* cache, test_case_t* test_case, uint64_t key) {
+    if (test_case->kind != TEST_KIND_SIMPLE && test_case->kind != TEST_KIND_PARAM) return false;
+    
+    // the file is shared, a count no run could have stored is not trusted
+    cache_slot_t* slot = cache_find(cache, key, false);
+    if (!slot || slot->result_count == 0 || slot->result_count > INT_MAX ||
+        (test_case->kind == TEST_KIND_PARAM && slot->result_count != (uint32_t)test_case->param_count) ||
+        reserve_results(test_case, (int)slot->result_count) != 0) {
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < slot->result_count; i++) {
+        test_case->results[i] = (test_status_t)slot->status;
+    }
+    test_case->result_count = (int)slot->result_count;
+    cache->hits++;
+    return true;
+}
+
+static void cache_record(result_cache_t* cache, test_case_t* test_case, uint64_t key) {
+    if (test_case->kind != TEST_KIND_SIMPLE && test_case->kind != TEST_KIND_PARAM) return;
+    cache->executed++;
+    
+    // only uniform passing results are worth replaying, and never a pass after retries
+    bool cacheable = test_case->result_count > 0 && test_case->attempts <= 1 &&
+                     !status_is_failure(test_case->results[0]);
+    for (int i = 1; cacheable && i < test_case->result_count; i++) {
+        cacheable = test_case->results[i] == test_case->results[0];
+    }
+    
+    if (cacheable) {
+        cache_store(cache, key, test_case->results[0], test_case->result_count);
+    } else {
+        cache_forget(cache, key);
+    }
+}
+
+typedef struct {
+    test_case_t* test_case;
+    uint64_t path_hash;
+    uint64_t cache_key;
+    const char* suite_path;
+} work_item_t;
+
+typedef struct {
+    work_item_t* items;
+    size_t count;
+    size_t capacity;
+} work_list_t;
+
+// suite paths are copied, the list outlives the walk that found the case
+static int work_list_push(work_list_t* list, test_case_t* test_case, uint64_t path_hash,
+                          const char* suite_path) {
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        work_item_t* new_items = realloc(list->items, new_capacity * sizeof(work_item_t));
+        if (!new_items) return -1;
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    
+    work_item_t* item = &list->items[list->count++];
+    item->test_case = test_case;
+    item->path_hash = path_hash;
+    item->cache_key = 0;
+    item->suite_path = suite_path ? strdup(suite_path) : NULL;
+    return 0;
+}
+
+static void work_list_free(work_list_t* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free((char*)list->items[i].suite_path);
+    }
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+// state of a single pass over the tree
+typedef struct {
+    test_runner_t* runner;
+    uint64_t* priority;
+    size_t priority_count;
+    bool progress;
+    uint64_t* failed;
+    size_t failed_count;
+    size_t failed_capacity;
+    work_list_t reruns;
+    work_list_t async_cases;
+    bool batch_async;
+    struct tap_stream* tap;
+} run_context_t;
+
+static void tap_case_done(struct tap_stream* tap, test_case_t* test_case);
+
+static int compare_hashes(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+static bool context_is_priority(const run_context_t* context, uint64_t path_hash) {
+    return context->priority_count > 0 &&
+           bsearch(&path_hash, context->priority, context->priority_count,
+                   sizeof(uint64_t), compare_hashes) != NULL;
+}
+
+static void context_case_done(run_context_t* context, test_case_t* test_case, uint64_t path_hash,
+                              const char* suite_path) {
+    bool failed = case_failed(test_case);
+    test_case->run_count++;
+    if (test_case->attempts > 1 && !failed) test_case->flaky_count++;
+    
+    if (failed && context->failed_count >= context->failed_capacity) {
+        size_t new_capacity = context->failed_capacity == 0 ? 64 : context->failed_capacity * 2;
+        uint64_t* new_failed = realloc(context->failed, new_capacity * sizeof(uint64_t));
+        if (new_failed) {
+            context->failed = new_failed;
+            context->failed_capacity = new_capacity;
+        }
+    }
+    if (failed && context->failed_count < context->failed_capacity) {
+        context->failed[context->failed_count++] = path_hash;
+    }
+    
+    // a failed append leaves the span stale, printing retries it
+    result_store_t* store = runner_store(context->runner);
+    if (store) store_append(store, test_case);
+    if (context->tap) tap_case_done(context->tap, test_case);
+    
+    if (!context->progress) return;
+    
+    // one line per finished case, flushed so the output is incremental
+    flockfile(stdout);
+    printf("%s%s%s: ", suite_path ? suite_path : "", suite_path ? "/" : "", test_case->name);
+    print_results(test_case);
+    printf("\n");
+    fflush(stdout);
+    funlockfile(stdout);
+}
+
+// tags are bits of a process-wide registry, so a case's tags and a filter's
+// terms are plain uint64_t masks
+#define TAG_NAME_CHARS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.:"
+#define TAG_FILTER_MAX_TERMS 4096
+
+static char* tag_names[TEST_MAX_TAGS];
+static int tag_count;
+
+static int find_tag(const char* name, size_t length) {
+    for (int i = 0; i < tag_count; i++) {
+        if (strlen(tag_names[i]) == length && memcmp(tag_names[i], name, length) == 0) return i;
+    }
+    return -1;
+}
+
+int test_tag_register(const char* name) {
+    if (!name || !*name || name[strspn(name, TAG_NAME_CHARS)] != '\0') return -1;
+    
+    pthread_mutex_lock(&registration_lock);
+    int tag = find_tag(name, strlen(name));
+    if (tag < 0 && tag_count < TEST_MAX_TAGS) {
+        tag_names[tag_count] = strdup(name);
+        if (tag_names[tag_count]) tag = tag_count++;
+    }
+    pthread_mutex_unlock(&registration_lock);
+    
+    if (tag < 0) fprintf(stderr, "Warning: Cannot register tag %s\n", name);
+    return tag;
+}
+
+int test_case_add_tag(test_case_t* test_case, const char* tag) {
+    if (!test_case) return -1;
+    
+    int bit = test_tag_register(tag);
+    if (bit < 0) return -1;
+    test_case->tags |= 1ULL << bit;
+    return 0;
+}
+
+int test_suite_add_tag(test_suite_t* suite, const char* tag) {
+    if (!suite) return -1;
+    
+    int bit = test_tag_register(tag);
+    if (bit < 0) return -1;
+    suite->tags |= 1ULL << bit;
+    return 0;
+}
+
+// a filter is kept in disjunctive normal form: a case matches when, for any
+// term, it has every required tag and none of the forbidden ones
+typedef struct {
+    uint64_t require;
+    uint64_t forbid;
+} tag_term_t;
+
+struct tag_filter {
+    tag_term_t* terms;
+    size_t count;
+};
+
+typedef struct {
+    const char* cursor;
+    bool failed;
+} tag_parser_t;
+
+static void filter_free(struct tag_filter* filter) {
+    if (!filter) return;
+    free(filter->terms);
+    free(filter);
+}
+
+static struct tag_filter* filter_new(size_t capacity) {
+    struct tag_filter* filter = malloc(sizeof(struct tag_filter));
+    if (!filter) return NULL;
+    filter->terms = malloc((capacity > 0 ? capacity : 1) * sizeof(tag_term_t));
+    filter->count = 0;
+    if (!filter->terms) {
+        free(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+static void filter_add(struct tag_filter* filter, uint64_t require, uint64_t forbid) {
+    // a term that requires and forbids the same tag never matches
+    if (require & forbid) return;
+    filter->terms[filter->count].require = require;
+    filter->terms[filter->count].forbid = forbid;
+    filter->count++;
+}
+
+static struct tag_filter* filter_or(struct tag_filter* a, struct tag_filter* b) {
+    struct tag_filter* result = a && b && a->count + b->count <= TAG_FILTER_MAX_TERMS ?
+                                filter_new(a->count + b->count) : NULL;
+    if (result) {
+        memcpy(result->terms, a->terms, a->count * sizeof(tag_term_t));
+        memcpy(result->terms + a->count, b->terms, b->count * sizeof(tag_term_t));
+        result->count = a->count + b->count;
+    }
+    filter_free(a);
+    filter_free(b);
+    return result;
+}
+
+static struct tag_filter* filter_and(struct tag_filter* a, struct tag_filter* b) {
+    struct tag_filter* result = a && b && a->count * b->count <= TAG_FILTER_MAX_TERMS ?
+                                filter_new(a->count * b->count) : NULL;
+    if (result) {
+        for (size_t i = 0; i < a->count; i++) {
+            for (size_t j = 0; j < b->count; j++) {
+                filter_add(result, a->terms[i].require | b->terms[j].require,
+                           a->terms[i].forbid | b->terms[j].forbid);
+            }
+        }
+    }
+    filter_free(a);
+    filter_free(b);
+    return result;
+}
+
+// De Morgan: the negation of a term is the disjunction of its negated
+// literals, and the negation of a disjunction is the conjunction of those
+static struct tag_filter* filter_not(struct tag_filter* a) {
+    if (!a) return NULL;
+    
+    struct tag_filter* result = filter_new(1);
+    if (result) filter_add(result, 0, 0);
+    for (size_t i = 0; i < a->count && result; i++) {
+        uint64_t literals = a->terms[i].require | a->terms[i].forbid;
+        struct tag_filter* negated = filter_new((size_t)__builtin_popcountll(literals));
+        if (!negated) {
+            filter_free(result);
+            result = NULL;
+            break;
+        }
+        for (int bit = 0; bit < 64; bit++) {
+            uint64_t mask = 1ULL << bit;
+            if (a->terms[i].require & mask) filter_add(negated, 0, mask);
+            if (a->terms[i].forbid & mask) filter_add(negated, mask, 0);
+        }
+        result = filter_and(result, negated);
+    }
+    filter_free(a);
+    return result;
+}
+
+static struct tag_filter* parse_or(tag_parser_t* parser);
+
+static void parser_skip_space(tag_parser_t* parser) {
+    while (*parser->cursor == ' ' || *parser->cursor == '\t') parser->cursor++;
+}
+
+static struct tag_filter* parse_primary(tag_parser_t* parser) {
+    parser_skip_space(parser);
+    if (*parser->cursor == '!') {
+        parser->cursor++;
+        return filter_not(parse_primary(parser));
+    }
+    if (*parser->cursor == '(') {
+        parser->cursor++;
+        struct tag_filter* inner = parse_or(parser);
+        parser_skip_space(parser);
+        if (*parser->cursor != ')') {
+            parser->failed = true;
+            filter_free(inner);
+            return NULL;
+        }
+        parser->cursor++;
+        return inner;
+    }
+    
+    size_t length = strspn(parser->cursor, TAG_NAME_CHARS);
+    if (length == 0) {
+        parser->failed = true;
+        return NULL;
+    }
+    
+    // a tag nobody registered matches no case
+    struct tag_filter* filter = filter_new(1);
+    if (filter) {
+        pthread_mutex_lock(&registration_lock);
+        int tag = find_tag(parser->cursor, length);
+        pthread_mutex_unlock(&registration_lock);
+        if (tag >= 0) filter_add(filter, 1ULL << tag, 0);
+    }
+    parser->cursor += length;
+    return filter;
+}
+
+static struct tag_filter* parse_and(tag_parser_t* parser) {
+    struct tag_filter* filter = parse_primary(parser);
+    for (;;) {
+        parser_skip_space(parser);
+        if (*parser->cursor != '&' || !filter) return filter;
+        parser->cursor++;
+        filter = filter_and(filter, parse_primary(parser));
+    }
+}
+
+static struct tag_filter* parse_or(tag_parser_t* parser) {
+    struct tag_filter* filter = parse_and(parser);
+    for (;;) {
+        parser_skip_space(parser);
+        if ((*parser->cursor != '|' && *parser->cursor != ',') || !filter) return filter;
+        parser->cursor++;
+        filter = filter_or(filter, parse_and(parser));
+    }
+}
+
+static struct tag_filter* parse_filter(const char* expression) {
+    tag_parser_t parser = { expression, false };
+    struct tag_filter* filter = parse_or(&parser);
+    parser_skip_space(&parser);
+    if (parser.failed || *parser.cursor != '\0') {
+        filter_free(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+// checked now, but only turned into masks when a run starts, so the
+// expression may name tags that are registered later
+int test_runner_set_filter(test_runner_t* runner, const char* expression) {
+    if (!runner) return -1;
+    
+    char* copy = NULL;
+    if (expression && *expression) {
+        struct tag_filter* filter = parse_filter(expression);
+        if (!filter) return -1;
+        filter_free(filter);
+        
+        copy = strdup(expression);
+        if (!copy) return -1;
+    }
+    
+    free(runner->filter);
+    runner->filter = copy;
+    return 0;
+}
+
+static bool filter_matches(const struct tag_filter* filter, uint64_t tags) {
+    for (size_t i = 0; i < filter->count; i++) {
+        if ((tags & filter->terms[i].require) == filter->terms[i].require &&
+            (tags & filter->terms[i].forbid) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// tags come flattened by the plan, one inherited mask per case, so every
+// term is checked against all of them in a branch-free loop
+static void select_cases(test_runner_t* runner, test_case_t** cases, const uint64_t* tags, size_t count) {
+    // tags registered since the filter was set can push it past the term
+    // limit; running everything instead would ignore the filter
+    struct tag_filter* filter = runner->filter ? parse_filter(runner->filter) : NULL;
+    if (runner->filter && !filter) {
+        fprintf(stderr, "Warning: Cannot apply tag filter %s, no cases selected\n", runner->filter);
+    }
+    
+    unsigned char* keep = filter && count > 0 ? calloc(count, 1) : NULL;
+    if (!keep) {
+        // no filter, one that failed, or no memory for the mask: one case at a time
+        for (size_t i = 0; i < count; i++) {
+            cases[i]->filtered = runner->filter && (!filter || !filter_matches(filter, tags[i]));
+        }
+    } else {
+        for (size_t term = 0; term < filter->count; term++) {
+            uint64_t require = filter->terms[term].require;
+            uint64_t forbid = filter->terms[term].forbid;
+            for (size_t i = 0; i < count; i++) {
+                keep[i] |= ((tags[i] & require) == require) & ((tags[i] & forbid) == 0);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            cases[i]->filtered = !keep[i];
+        }
+    }
+    
+    free(keep);
+    filter_free(filter);
+}
+
+// fds 1 and 2 are swapped for a scratch file around each case; they belong
+// to the whole process, so this only works while one case runs at a time:
+// serially and in worker processes, not in the thread pool
+typedef struct {
+    bool active;
+    int fd;
+    int saved[2];
+} output_capture_t;
+
+static output_capture_t output_capture = { false, -1, { -1, -1 } };
+
+static int capture_file(void) {
+    int fd;
+#ifdef __linux__
+    fd = memfd_create("unittest-output", 0);
+    if (fd >= 0) return fd;
+#endif
+    const char* directory = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/unittest-output-XXXXXX", directory && *directory ? directory : "/tmp");
+    fd = mkstemp(path);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+static void capture_open(const test_runner_t* runner) {
+    if (!runner->capture || output_capture.active) return;
+    
+    output_capture.fd = capture_file();
+    output_capture.saved[0] = dup(STDOUT_FILENO);
+    output_capture.saved[1] = dup(STDERR_FILENO);
+    if (output_capture.fd < 0 || output_capture.saved[0] < 0 || output_capture.saved[1] < 0) {
+        fprintf(stderr, "Warning: Cannot capture test output\n");
+        if (output_capture.fd >= 0) close(output_capture.fd);
+        if (output_capture.saved[0] >= 0) close(output_capture.saved[0]);
+        if (output_capture.saved[1] >= 0) close(output_capture.saved[1]);
+        output_capture.fd = -1;
+        return;
+    }
+    
+    // a re-exec in watch mode must not inherit them
+    fcntl(output_capture.fd, F_SETFD, FD_CLOEXEC);
+    fcntl(output_capture.saved[0], F_SETFD, FD_CLOEXEC);
+    fcntl(output_capture.saved[1], F_SETFD, FD_CLOEXEC);
+    output_capture.active = true;
+}
+
+static void capture_close(void) {
+    if (!output_capture.active) return;
+    
+    close(output_capture.fd);
+    close(output_capture.saved[0]);
+    close(output_capture.saved[1]);
+    output_capture.active = false;
+    output_capture.fd = -1;
+}
+
+static bool capture_begin(void) {
+    if (!output_capture.active) return false;
+    
+    fflush(stdout);
+    fflush(stderr);
+    dup2(output_capture.fd, STDOUT_FILENO);
+    dup2(output_capture.fd, STDERR_FILENO);
+    return true;
+}
+
+// both fds share the file offset, so a case that printed nothing costs an
+// lseek and no copy; otherwise the last CAPTURE_LIMIT bytes are kept
+static char* capture_end(void) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(output_capture.saved[0], STDOUT_FILENO);
+    dup2(output_capture.saved[1], STDERR_FILENO);
+    
+    off_t size = lseek(output_capture.fd, 0, SEEK_CUR);
+    if (size <= 0) return NULL;
+    
+    size_t length = (size_t)size < CAPTURE_LIMIT ? (size_t)size : CAPTURE_LIMIT;
+    size_t skipped = (size_t)size - length;
+    char* output = malloc(length + 1);
+    if (output) {
+        ssize_t got = pread(output_capture.fd, output, length, (off_t)skipped);
+        length = got > 0 ? (size_t)got : 0;
+        output[length] = '\0';
+        
+        // a cut-off first line is dropped and marked instead
+        char* newline = skipped > 0 ? memchr(output, '\n', length) : NULL;
+        if (newline && (size_t)(newline - output) >= 3) {
+            memcpy(newline - 3, "...", 3);
+            memmove(output, newline - 3, length - (size_t)(newline - 3 - output) + 1);
+        }
+    }
+    
+    if (ftruncate(output_capture.fd, 0) != 0 || lseek(output_capture.fd, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Warning: Cannot reset captured output\n");
+    }
+    return output;
+}
+
+// output goes with the first failure, passing cases only keep it when verbose
+static void attach_output(const test_runner_t* runner, test_case_t* test_case, char* output) {
+    if (!output) return;
+    
+    int result = 0;
+    while (result < test_case->result_count && !status_is_failure(test_case->results[result])) {
+        result++;
+    }
+    if (result == test_case->result_count && !(runner->verbose && test_case->result_count > 0)) {
+        free(output);
+        return;
+    }
+    if (result == test_case->result_count) result = 0;
+    
+    lock_results(test_case);
+    diagnostic_record_t* record = find_diagnostic(test_case->diagnostics, result);
+    if (record) {
+        record->diagnostic.output = arena_copy(&test_case->diagnostics->arena, output);
+    } else {
+        test_diagnostic_t diagnostic = { NULL, NULL, 0, 0, output };
+        store_diagnostic(test_case, result, &diagnostic, NULL);
+    }
+    unlock_results(test_case);
+    free(output);
+}
+
+// threads is what the case may use on its own, 1 inside the worker pool
+static void run_test_case(test_runner_t* runner, test_case_t* test_case, int threads) {
+    // cases with manual results are not executed
+    if (test_case->result_count != 0) return;
+    
+    // a loop of its own, timed per case by the loop
+    if (test_case->kind == TEST_KIND_ASYNC) {
+        run_async_cases(&test_case, 1);
+        return;
+    }
+    
+    test_case->attempts++;
+    clear_failure();
+    bool captured = capture_begin();
+    uint64_t start = runner->timing ? monotonic_ns() : 0;
+    switch (test_case->kind) {
+        case TEST_KIND_SIMPLE:
+            if (test_case->test_func) {
+                test_status_t result = test_case->test_func();
+                if (add_case_result(test_case, result) != 0) {
+                    fprintf(stderr, "Warning: Failed to add test result for %s\n", 
+                           test_case->name);
+                }
+            }
+            break;
+        case TEST_KIND_PARAM:
+            for (int i = 0; i < test_case->param_count; i++) {
+                test_status_t result = test_case->param_func(test_case_param_row(test_case, i));
+                if (add_case_result(test_case, result) != 0) {
+                    fprintf(stderr, "Warning: Failed to add test result for %s[%d]\n", 
+                           test_case->name, i);
+                    break;
+                }
+            }
+            break;
+        case TEST_KIND_PROPERTY:
+            if (add_case_result(test_case, run_property_case(runner, test_case, threads)) != 0) {
+                fprintf(stderr, "Warning: Failed to add test result for %s\n", 
+                       test_case->name);
+            }
+            break;
+        case TEST_KIND_FUZZ:
+            run_fuzz_case(test_case);
+            break;
+        case TEST_KIND_STRESS:
+            run_stress_case(test_case);
+            break;
+        case TEST_KIND_ASYNC:
+            break;
+    }
+    if (runner->timing) test_case->duration_ns += monotonic_ns() - start;
+    if (captured) attach_output(runner, test_case, capture_end());
+}
+
+static bool case_wants_retry(const test_runner_t* runner, const test_case_t* test_case) {
+    return test_case->attempts > 0 && test_case->attempts <= runner->retries && case_failed(test_case);
+}
+
+// a retried case starts over, only the last attempt's results are kept
+static void reset_case_results(test_case_t* test_case) {
+    test_case->result_count = 0;
+    free(test_case->report);
+    test_case->report = NULL;
+    free_diagnostics(test_case);
+}
+
+// failing cases are put aside and retried once everything else has run
+static void context_defer(run_context_t* context, test_case_t* test_case, uint64_t path_hash,
+                          const char* suite_path) {
+    if (work_list_push(&context->reruns, test_case, path_hash, suite_path) != 0) {
+        context_case_done(context, test_case, path_hash, suite_path);
+    }
+}
+
+static void context_finish_case(run_context_t* context, test_case_t* test_case, uint64_t path_hash,
+                                const char* suite_path) {
+    if (case_wants_retry(context->runner, test_case)) {
+        context_defer(context, test_case, path_hash, suite_path);
+    } else {
+        context_case_done(context, test_case, path_hash, suite_path);
+    }
+}
+
+static void rerun_case(run_context_t* context, work_item_t* item, int threads) {
+    while (case_wants_retry(context->runner, item->test_case)) {
+        reset_case_results(item->test_case);
+        run_test_case(context->runner, item->test_case, threads);
+    }
+}
+
+// a run is compiled from the tree first: cases in DFS order with their path
+// hashes and suites, and the entries to execute in the order they run, so
+// the executors walk arrays instead of next pointers
+#define PLAN_ASYNC 0x1      // batched on event loops when the context allows
+#define PLAN_REPLAY 0x2     // the result cache may replay it
+#define PLAN_SKIP 0x4       // replayed or batched before the run
+#define PLAN_NO_SUITE UINT32_MAX
+#define PLAN_CHUNK 64       // most entries a pool thread claims at once
+
+typedef struct {
+    test_func_t func;       // set for plain cases, which take the fast path
+    uint32_t case_index;
+    uint32_t suite_index;
+    uint32_t flags;
+} plan_entry_t;
+
+typedef struct {
+    test_suite_t* suite;
+    uint32_t parent;
+    char* path;             // "A/B", only built for progress output
+} plan_suite_t;
+
+typedef struct {
+    // by case index, subtrees are contiguous
+    test_case_t** cases;
+    uint64_t* hashes;
+    uint64_t* tags;         // inherited masks, dropped after selection
+    uint32_t* case_suites;
+    size_t case_count;
+    size_t case_capacity;
+    plan_suite_t* suites;
+    size_t suite_count;
+    size_t suite_capacity;
+
+    // by entry, priority cases first
+    plan_entry_t* entries;
+    size_t count;
+    uint8_t* statuses;      // filled by the fast path, then committed
+    uint64_t* durations;
+    uint64_t* keys;         // cache keys, only with a cache
+    size_t async_count;
+} run_plan_t;
+
+// TAP 14 stream: cases are written in DFS order as they finish, so a case
+// that finishes early waits in ready until everything before it is written;
+// suites become subtests, opened before their first case and closed after
+// their last one
+#define TAP_BUFFER_SIZE (1 << 16)
+
+typedef struct {
+    uint32_t suite;
+    int points;
+    bool failed;
+} tap_level_t;
+
+struct tap_stream {
+    FILE* file;
+    test_case_t** cases;        // by DFS index
+    uint32_t* case_suites;
+    uint8_t* ready;
+    size_t count;
+    size_t next;
+    test_suite_t** suites;      // by plan suite index, subtrees are contiguous
+    uint32_t* parents;
+    uint32_t* depths;
+    uint32_t* ends;             // one past the last suite of the subtree
+    tap_level_t* levels;        // open subtests, levels[0] is the document
+    int depth;
+};
+
+static void tap_indent(FILE* file, int level) {
+    for (int i = 0; i < level; i++) fputs("    ", file);
+}
+
+// descriptions escape '#' and '\'
+static void tap_write_name(FILE* file, const char* name) {
+    for (const char* c = name; *c; c++) {
+        if (*c == '#' || *c == '\\') fputc('\\', file);
+        fputc(*c == '\n' ? ' ' : *c, file);
+    }
+}
+
+static void tap_write_string(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (*c == '\n') {
+            fputs("\\n", file);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// the first failure detail, or else the report line, e.g. a property's
+// counterexample; a case with both keeps the report as its own key
+static void tap_write_diagnostic(FILE* file, int level, test_case_t* test_case) {
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    diagnostic_record_t* record = diagnostics && diagnostics->count > 0 ? &diagnostics->records[0] : NULL;
+    if (!record && !test_case->report) return;
+    
+    test_diagnostic_t empty;
+    memset(&empty, 0, sizeof(empty));
+    const test_diagnostic_t* diagnostic = record ? resolve_diagnostic(diagnostics, record) : &empty;
+    const char* message = diagnostic->message ? diagnostic->message : test_case->report;
+    tap_indent(file, level);
+    fputs("  ---\n", file);
+    if (message) {
+        tap_indent(file, level);
+        fputs("  message: ", file);
+        tap_write_string(file, message);
+        fputc('\n', file);
+    }
+    if (test_case->report && message != test_case->report) {
+        tap_indent(file, level);
+        fputs("  report: ", file);
+        tap_write_string(file, test_case->report);
+        fputc('\n', file);
+    }
+    if (diagnostic->file) {
+        tap_indent(file, level);
+        fputs("  at: ", file);
+        char at[REPORT_LIMIT];
+        snprintf(at, sizeof(at), "%s:%d", diagnostic->file, diagnostic->line);
+        tap_write_string(file, at);
+        fputc('\n', file);
+    }
+    if (diagnostic->signal > 0) {
+        tap_indent(file, level);
+        fprintf(file, "  signal: %d\n", diagnostic->signal);
+    }
+    if (record && test_case->result_count > 1) {
+        tap_indent(file, level);
+        fprintf(file, "  result: %d\n", record->result);
+    }
+    tap_indent(file, level);
+    fputs("  ...\n", file);
+}
+
+static void tap_open_level(struct tap_stream* tap, uint32_t suite) {
+    tap_level_t* level = &tap->levels[++tap->depth];
+    level->suite = suite;
+    level->points = 0;
+    level->failed = false;
+    tap_indent(tap->file, tap->depth - 1);
+    fputs("# Subtest: ", tap->file);
+    tap_write_name(tap->file, tap->suites[suite]->name);
+    fputc('\n', tap->file);
+}
+
+// the subtest's plan, then its own test point in the parent
+static void tap_close_level(struct tap_stream* tap) {
+    tap_level_t* level = &tap->levels[tap->depth--];
+    tap_level_t* parent = &tap->levels[tap->depth];
+    tap_indent(tap->file, tap->depth + 1);
+    fprintf(tap->file, "1..%d\n", level->points);
+    
+    parent->points++;
+    parent->failed |= level->failed;
+    tap_indent(tap->file, tap->depth);
+    fprintf(tap->file, "%s %d - ", level->failed ? "not ok" : "ok", parent->points);
+    tap_write_name(tap->file, tap->suites[level->suite]->name);
+    fputc('\n', tap->file);
+}
+
+// closes the subtests that do not contain suite, opens the ones that do
+static void tap_enter_suite(struct tap_stream* tap, uint32_t suite) {
+    while (tap->depth > 0) {
+        uint32_t open = tap->levels[tap->depth].suite;
+        if (open <= suite && suite < tap->ends[open]) break;
+        tap_close_level(tap);
+    }
+    
+    // ancestors not open yet go to their levels first, then open outermost first
+    int target = (int)tap->depths[suite] + 1;
+    uint32_t current = suite;
+    while (current != PLAN_NO_SUITE && (int)tap->depths[current] >= tap->depth) {
+        tap->levels[tap->depths[current] + 1].suite = current;
+        current = tap->parents[current];
+    }
+    while (tap->depth < target) tap_open_level(tap, tap->levels[tap->depth + 1].suite);
+}
+
+// failures are not ok, expected errors not ok with a TODO, cases that were
+// filtered out or produced nothing ok with a SKIP
+static void tap_write_case(struct tap_stream* tap, size_t index) {
+    test_case_t* test_case = tap->cases[index];
+    tap_enter_suite(tap, tap->case_suites[index]);
+    
+    bool failed = false;
+    const char* expected = NULL;
+    for (int i = 0; i < test_case->result_count && !test_case->filtered; i++) {
+        test_status_t status = test_case->results[i];
+        if (status_is_failure(status)) failed = true;
+        if (status == STATUS_EXPECTED_BUILD_ERROR) expected = "expected build error";
+        if (status == STATUS_EXPECTED_RUNTIME_ERROR && !expected) expected = "expected runtime error";
+    }
+    
+    tap_level_t* level = &tap->levels[tap->depth];
+    level->points++;
+    level->failed |= failed;
+    tap_indent(tap->file, tap->depth);
+    fprintf(tap->file, "%s %d - ", failed || expected ? "not ok" : "ok", level->points);
+    tap_write_name(tap->file, test_case->name);
+    if (test_case->filtered) {
+        fputs(" # SKIP filtered", tap->file);
+    } else if (test_case->result_count == 0) {
+        fputs(" # SKIP no results", tap->file);
+    } else if (expected && !failed) {
+        fprintf(tap->file, " # TODO %s", expected);
+    }
+    fputc('\n', tap->file);
+    if (failed) tap_write_diagnostic(tap->file, tap->depth, test_case);
+}
+
+static void tap_advance(struct tap_stream* tap) {
+    while (tap->next < tap->count && tap->ready[tap->next]) {
+        tap_write_case(tap, tap->next++);
+    }
+}
+
+static void tap_case_done(struct tap_stream* tap, test_case_t* test_case) {
+    if (test_case->run_index >= tap->count || tap->cases[test_case->run_index] != test_case) return;
+    
+    tap->ready[test_case->run_index] = 1;
+    tap_advance(tap);
+}
+
+static void free_tap(struct tap_stream* tap) {
+    free(tap->cases);
+    free(tap->case_suites);
+    free(tap->ready);
+    free(tap->suites);
+    free(tap->parents);
+    free(tap->depths);
+    free(tap->ends);
+    free(tap->levels);
+    free(tap);
+}
+
+// copies what it needs from the plan, which is gone before async cases and
+// retries finish; every case that is not an entry is ready from the start
+static struct tap_stream* tap_start(test_runner_t* runner, const run_plan_t* plan) {
+    struct tap_stream* tap = calloc(1, sizeof(struct tap_stream));
+    if (!tap) return NULL;
+    
+    size_t cases = plan->case_count > 0 ? plan->case_count : 1;
+    size_t suites = plan->suite_count > 0 ? plan->suite_count : 1;
+    tap->cases = malloc(cases * sizeof(test_case_t*));
+    tap->case_suites = malloc(cases * sizeof(uint32_t));
+    tap->ready = malloc(cases);
+    tap->suites = malloc(suites * sizeof(test_suite_t*));
+    tap->parents = malloc(suites * sizeof(uint32_t));
+    tap->depths = malloc(suites * sizeof(uint32_t));
+    tap->ends = malloc(suites * sizeof(uint32_t));
+    if (!tap->cases || !tap->case_suites || !tap->ready || !tap->suites || !tap->parents ||
+        !tap->depths || !tap->ends) {
+        free_tap(tap);
+        return NULL;
+    }
+    
+    uint32_t max_depth = 0;
+    for (size_t i = 0; i < plan->suite_count; i++) {
+        uint32_t parent = plan->suites[i].parent;
+        tap->suites[i] = plan->suites[i].suite;
+        tap->parents[i] = parent;
+        tap->depths[i] = parent == PLAN_NO_SUITE ? 0 : tap->depths[parent] + 1;
+        tap->ends[i] = (uint32_t)i + 1;
+        if (tap->depths[i] > max_depth) max_depth = tap->depths[i];
+    }
+    for (size_t i = plan->suite_count; i-- > 0;) {
+        uint32_t parent = tap->parents[i];
+        if (parent != PLAN_NO_SUITE && tap->ends[i] > tap->ends[parent]) tap->ends[parent] = tap->ends[i];
+    }
+    tap->levels = calloc(max_depth + 2, sizeof(tap_level_t));
+    if (!tap->levels) {
+        free_tap(tap);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < plan->case_count; i++) {
+        tap->cases[i] = plan->cases[i];
+        tap->case_suites[i] = plan->case_suites[i];
+        tap->ready[i] = 1;
+        plan->cases[i]->run_index = (uint32_t)i;
+    }
+    for (size_t i = 0; i < plan->count; i++) {
+        tap->ready[plan->entries[i].case_index] = 0;
+    }
+    tap->count = plan->case_count;
+    
+    tap->file = fopen(runner->tap_path, "w");
+    if (!tap->file) {
+        free_tap(tap);
+        return NULL;
+    }
+    setvbuf(tap->file, NULL, _IOFBF, TAP_BUFFER_SIZE);
+    fputs("TAP version 14\n", tap->file);
+    tap_advance(tap);
+    return tap;
+}
+
+// whatever never reported back, e.g. cases lost with a worker, is written
+// with the results it has
+static void tap_finish(run_context_t* context) {
+    struct tap_stream* tap = context->tap;
+    if (!tap) return;
+    
+    while (tap->next < tap->count) {
+        tap_write_case(tap, tap->next++);
+    }
+    while (tap->depth > 0) tap_close_level(tap);
+    fprintf(tap->file, "1..%d\n", tap->levels[0].points);
+    if (fclose(tap->file) != 0) {
+        fprintf(stderr, "Warning: Failed to write TAP output %s\n", context->runner->tap_path);
+    }
+    free_tap(tap);
+    context->tap = NULL;
+}
+
+static int plan_reserve_cases(run_plan_t* plan, size_t needed) {
+    if (needed <= plan->case_capacity) return 0;
+    
+    size_t new_capacity = plan->case_capacity == 0 ? 1024 : plan->case_capacity * 2;
+    while (new_capacity < needed) new_capacity *= 2;
+    test_case_t** new_cases = realloc(plan->cases, new_capacity * sizeof(test_case_t*));
+    if (!new_cases) return -1;
+    plan->cases = new_cases;
+    uint64_t* new_hashes = realloc(plan->hashes, new_capacity * sizeof(uint64_t));
+    if (!new_hashes) return -1;
+    plan->hashes = new_hashes;
+    uint64_t* new_tags = realloc(plan->tags, new_capacity * sizeof(uint64_t));
+    if (!new_tags) return -1;
+    plan->tags = new_tags;
+    uint32_t* new_suites = realloc(plan->case_suites, new_capacity * sizeof(uint32_t));
+    if (!new_suites) return -1;
+    plan->case_suites = new_suites;
+    plan->case_capacity = new_capacity;
+    return 0;
+}
+
+static int plan_add_suite(run_plan_t* plan, test_suite_t* suite, uint32_t parent,
+                          uint64_t parent_hash, uint64_t inherited, bool paths) {
+    if (plan->suite_count >= plan->suite_capacity) {
+        size_t new_capacity = plan->suite_capacity == 0 ? 64 : plan->suite_capacity * 2;
+        plan_suite_t* new_suites = realloc(plan->suites, new_capacity * sizeof(plan_suite_t));
+        if (!new_suites) return -1;
+        plan->suites = new_suites;
+        plan->suite_capacity = new_capacity;
+    }
+    
+    uint32_t index = (uint32_t)plan->suite_count++;
+    plan_suite_t* entry = &plan->suites[index];
+    entry->suite = suite;
+    entry->parent = parent;
+    entry->path = NULL;
+    if (paths) {
+        const char* parent_path = parent != PLAN_NO_SUITE ? plan->suites[parent].path : NULL;
+        size_t length = (parent_path ? strlen(parent_path) + 1 : 0) + strlen(suite->name) + 1;
+        entry->path = malloc(length);
+        if (entry->path) {
+            snprintf(entry->path, length, "%s%s%s", parent_path ? parent_path : "",
+                     parent_path ? "/" : "", suite->name);
+        }
+    }
+    
+    uint64_t suite_hash = path_hash_extend(parent_hash, suite->name);
+    uint64_t tags = inherited | suite->tags;
+    for (test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        if (plan_reserve_cases(plan, plan->case_count + 1) != 0) return -1;
+        size_t i = plan->case_count++;
+        current_case->filtered = false;
+        plan->cases[i] = current_case;
+        plan->hashes[i] = path_hash_extend(suite_hash, current_case->name);
+        plan->tags[i] = tags | current_case->tags;
+        plan->case_suites[i] = index;
+    }
+    for (test_suite_t* child = suite->child_suites; child; child = child->next) {
+        if (plan_add_suite(plan, child, index, suite_hash, tags, paths) != 0) return -1;
+    }
+    return 0;
+}
+
+static void free_plan(run_plan_t* plan) {
+    for (size_t i = 0; i < plan->suite_count; i++) {
+        free(plan->suites[i].path);
+    }
+    free(plan->suites);
+    free(plan->cases);
+    free(plan->hashes);
+    free(plan->tags);
+    free(plan->case_suites);
+    free(plan->entries);
+    free(plan->statuses);
+    free(plan->durations);
+    free(plan->keys);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// one walk of the tree, then selection and ordering work on the arrays
+static int compile_plan(run_context_t* context, run_plan_t* plan) {
+    test_runner_t* runner = context->runner;
+    memset(plan, 0, sizeof(*plan));
+    
+    for (test_suite_t* suite = runner->root_suite; suite; suite = suite->next) {
+        if (plan_add_suite(plan, suite, PLAN_NO_SUITE, PATH_HASH_ROOT, 0, context->progress) != 0) return -1;
+    }
+    
+    if (runner->filter) select_cases(runner, plan->cases, plan->tags, plan->case_count);
+    free(plan->tags);
+    plan->tags = NULL;
+    
+    // shards split by path hash, so adding a case never moves the others
+    if (runner->shard_count > 1) {
+        for (size_t i = 0; i < plan->case_count; i++) {
+            if (plan->hashes[i] % (uint64_t)runner->shard_count != (uint64_t)runner->shard_index) {
+                plan->cases[i]->filtered = true;
+            }
+        }
+    }
+    
+    size_t capacity = plan->case_count > 0 ? plan->case_count : 1;
+    plan->entries = malloc(capacity * sizeof(plan_entry_t));
+    plan->statuses = malloc(capacity);
+    plan->durations = malloc(capacity * sizeof(uint64_t));
+    if (!plan->entries || !plan->statuses || !plan->durations) return -1;
+    
+    // previously failing cases go first, the second pass skips them
+    for (int pass = context->priority_count > 0 ? 0 : 1; pass < 2; pass++) {
+        for (size_t i = 0; i < plan->case_count; i++) {
+            test_case_t* test_case = plan->cases[i];
+            if (test_case->result_count != 0 || test_case->filtered) continue;
+            if (context->priority_count > 0 && context_is_priority(context, plan->hashes[i]) != (pass == 0)) {
+                continue;
+            }
+            
+            plan_entry_t* entry = &plan->entries[plan->count++];
+            entry->func = test_case->kind == TEST_KIND_SIMPLE ? test_case->test_func : NULL;
+            entry->case_index = (uint32_t)i;
+            entry->suite_index = plan->case_suites[i];
+            entry->flags = 0;
+            if (test_case->kind == TEST_KIND_ASYNC) {
+                entry->flags |= PLAN_ASYNC;
+                plan->async_count++;
+            }
+            if (test_case->kind == TEST_KIND_SIMPLE || test_case->kind == TEST_KIND_PARAM) {
+                entry->flags |= PLAN_REPLAY;
+            }
+        }
+    }
+    
+    if (runner->tap_path) {
+        context->tap = tap_start(runner, plan);
+        if (!context->tap) fprintf(stderr, "Warning: Cannot open TAP output %s\n", runner->tap_path);
+    }
+    return 0;
+}
+
+static test_case_t* plan_case(const run_plan_t* plan, const plan_entry_t* entry) {
+    return plan->cases[entry->case_index];
+}
+
+static void plan_case_done(run_context_t* context, const run_plan_t* plan, const plan_entry_t* entry) {
+    context_case_done(context, plan_case(plan, entry), plan->hashes[entry->case_index],
+                      plan->suites[entry->suite_index].path);
+}
+
+static void plan_finish_case(run_context_t* context, const run_plan_t* plan, const plan_entry_t* entry) {
+    context_finish_case(context, plan_case(plan, entry), plan->hashes[entry->case_index],
+                        plan->suites[entry->suite_index].path);
+}
+
+// async cases are set aside and cached results replayed before anything runs
+static void prepare_plan(run_context_t* context, run_plan_t* plan) {
+    result_cache_t* cache = context->runner->cache;
+    if (plan->async_count == 0 && !cache) return;
+    
+    bool replay = cache && cache_acquire(cache) == 0;
+    if (replay) plan->keys = calloc(plan->count > 0 ? plan->count : 1, sizeof(uint64_t));
+    for (size_t i = 0; i < plan->count; i++) {
+        plan_entry_t* entry = &plan->entries[i];
+        test_case_t* test_case = plan_case(plan, entry);
+        if ((entry->flags & PLAN_ASYNC) && context->batch_async &&
+            work_list_push(&context->async_cases, test_case, plan->hashes[entry->case_index],
+                           plan->suites[entry->suite_index].path) == 0) {
+            entry->flags |= PLAN_SKIP;
+            continue;
+        }
+        
+        if (plan->keys && (entry->flags & PLAN_REPLAY)) {
+            plan->keys[i] = cache_key(cache, test_case, plan->hashes[entry->case_index]);
+            if (cache_replay(cache, test_case, plan->keys[i])) {
+                entry->flags |= PLAN_SKIP;
+                plan_case_done(context, plan, entry);
+            }
+        }
+    }
+    if (replay) cache_release(cache);
+}
+
+static void record_plan(test_runner_t* runner, const run_plan_t* plan) {
+    if (!runner->cache || !plan->keys || cache_acquire(runner->cache) != 0) return;
+    
+    for (size_t i = 0; i < plan->count; i++) {
+        const plan_entry_t* entry = &plan->entries[i];
+        if ((entry->flags & (PLAN_REPLAY | PLAN_SKIP)) == PLAN_REPLAY) {
+            cache_record(runner->cache, plan_case(plan, entry), plan->keys[i]);
+        }
+    }
+    cache_release(runner->cache);
+}
+
+// the fast path: plain functions called back to back, statuses go to a
+// column and nothing else is touched; stops after the first failure so its
+// pending assertion is still the last one when committed
+static size_t dispatch_plan(run_plan_t* plan, size_t begin, size_t end, bool timing) {
+    const plan_entry_t* entries = plan->entries;
+    uint64_t last = timing ? monotonic_ns() : 0;
+    size_t i = begin;
+    while (i < end && entries[i].func && !(entries[i].flags & PLAN_SKIP)) {
+        clear_failure();
+        test_status_t status = entries[i].func();
+        // the column is bytes, a status that does not fit must not wrap into a valid one
+        if (UNITTEST_UNLIKELY((unsigned)status > STATUS_RUNTIME_ERROR)) status = STATUS_RUNTIME_ERROR;
+        plan->statuses[i] = (uint8_t)status;
+        if (timing) {
+            uint64_t now = monotonic_ns();
+            plan->durations[i] = now - last;
+            last = now;
+        }
+        i++;
+        if (UNITTEST_UNLIKELY(status_is_failure(status))) break;
+    }
+    return i;
+}
+
+static void commit_plan(run_context_t* context, run_plan_t* plan, size_t begin, size_t end,
+                        pthread_mutex_t* lock) {
+    bool timing = context->runner->timing;
+    for (size_t i = begin; i < end; i++) {
+        test_case_t* test_case = plan_case(plan, &plan->entries[i]);
+        test_status_t status = (test_status_t)plan->statuses[i];
+        test_case->attempts++;
+        if (timing) test_case->duration_ns += plan->durations[i];
+        
+        lock_results(test_case);
+        int index = test_case->result_count;
+        int result = append_result(test_case, status);
+        unlock_results(test_case);
+        if (result != 0) {
+            fprintf(stderr, "Warning: Failed to add test result for %s\n", test_case->name);
+        } else if (status_is_failure(status)) {
+            take_failure(test_case, index);
+        }
+    }
+    
+    if (lock) pthread_mutex_lock(lock);
+    for (size_t i = begin; i < end; i++) {
+        plan_finish_case(context, plan, &plan->entries[i]);
+    }
+    if (lock) pthread_mutex_unlock(lock);
+}
+
+// lock guards the context when pool threads share it
+static void run_plan_range(run_context_t* context, run_plan_t* plan, size_t begin, size_t end,
+                           int threads, pthread_mutex_t* lock) {
+    test_runner_t* runner = context->runner;
+    
+    // a captured case needs its own fds swapped, so capturing runs take the slow path
+    bool fast = !output_capture.active;
+    size_t i = begin;
+    while (i < end) {
+        plan_entry_t* entry = &plan->entries[i];
+        if (entry->flags & PLAN_SKIP) {
+            i++;
+            continue;
+        }
+        
+        size_t stop = fast && entry->func ? dispatch_plan(plan, i, end, runner->timing) : i;
+        if (stop > i) {
+            commit_plan(context, plan, i, stop, lock);
+            i = stop;
+            continue;
+        }
+        
+        run_test_case(runner, plan_case(plan, entry), threads);
+        if (lock) pthread_mutex_lock(lock);
+        plan_finish_case(context, plan, entry);
+        if (lock) pthread_mutex_unlock(lock);
+        i++;
+    }
+}
+
+typedef struct {
+    run_context_t* context;
+    run_plan_t* plan;
+    size_t chunk;
+    size_t next;
+    pthread_mutex_t lock;
+} plan_pool_t;
+
+static void* plan_worker(void* arg) {
+    plan_pool_t* pool = arg;
+    
+    for (;;) {
+        size_t begin = __atomic_fetch_add(&pool->next, pool->chunk, __ATOMIC_RELAXED);
+        if (begin >= pool->plan->count) break;
+        
+        size_t end = begin + pool->chunk < pool->plan->count ? begin + pool->chunk : pool->plan->count;
+        run_plan_range(pool->context, pool->plan, begin, end, 1, &pool->lock);
+    }
+    return NULL;
+}
+
+// chunks shrink with the run so a few slow cases still spread over all threads
+static void execute_parallel(run_context_t* context, run_plan_t* plan) {
+    test_runner_t* runner = context->runner;
+    plan_pool_t pool;
+    pool.context = context;
+    pool.plan = plan;
+    pool.next = 0;
+    pool.chunk = plan->count / ((size_t)runner->jobs * 16);
+    if (pool.chunk < 1) pool.chunk = 1;
+    if (pool.chunk > PLAN_CHUNK) pool.chunk = PLAN_CHUNK;
+    
+    pthread_mutex_init(&pool.lock, NULL);
+    int threads = (size_t)runner->jobs < plan->count ? runner->jobs : (int)plan->count;
+    run_threads(threads, plan_worker, &pool);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+typedef struct {
+    run_context_t* context;
+    work_item_t* items;
+    size_t count;
+    size_t capacity;
+    size_t next;
+    run_plan_t plan;        // owns the suite paths of the items
+    pthread_mutex_t lock;
+} work_queue_t;
+
+static int queue_push(work_queue_t* queue, test_case_t* test_case, uint64_t path_hash,
+                      uint64_t cache_key, const char* suite_path) {
+    if (queue->count >= queue->capacity) {
+        size_t new_capacity = queue->capacity == 0 ? 256 : queue->capacity * 2;
+        work_item_t* new_items = realloc(queue->items, new_capacity * sizeof(work_item_t));
+        if (!new_items) return -1;
+        queue->items = new_items;
+        queue->capacity = new_capacity;
+    }
+    
+    work_item_t* item = &queue->items[queue->count++];
+    item->test_case = test_case;
+    item->path_hash = path_hash;
+    item->cache_key = cache_key;
+    item->suite_path = suite_path;
+    return 0;
+}
+
+// retries of failed cases, spread over the pool
+static void* pool_worker(void* arg) {
+    work_queue_t* queue = arg;
+    
+    for (;;) {
+        size_t index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (index >= queue->count) break;
+        
+        work_item_t* item = &queue->items[index];
+        rerun_case(queue->context, item, 1);
+        
+        pthread_mutex_lock(&queue->lock);
+        context_case_done(queue->context, item->test_case, item->path_hash, item->suite_path);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return NULL;
+}
+
+// the plan as a queue of items, for the coordinator's batches
+static int collect_cases(run_context_t* context, work_queue_t* queue) {
+    memset(queue, 0, sizeof(*queue));
+    queue->context = context;
+    if (compile_plan(context, &queue->plan) != 0) return -1;
+    prepare_plan(context, &queue->plan);
+    
+    const run_plan_t* plan = &queue->plan;
+    for (size_t i = 0; i < plan->count; i++) {
+        const plan_entry_t* entry = &plan->entries[i];
+        if (entry->flags & PLAN_SKIP) continue;
+        if (queue_push(queue, plan_case(plan, entry), plan->hashes[entry->case_index],
+                       plan->keys ? plan->keys[i] : 0, plan->suites[entry->suite_index].path) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_queue(work_queue_t* queue) {
+    free_plan(&queue->plan);
+    free(queue->items);
+}
+
+typedef struct {
+    test_case_t** cases;
+    size_t count;
+    size_t slices;
+    size_t next;
+} async_batch_t;
+
+static void* async_worker(void* arg) {
+    async_batch_t* batch = arg;
+    
+    for (;;) {
+        size_t slice = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (slice >= batch->slices) break;
+        
+        size_t begin = batch->count * slice / batch->slices;
+        size_t end = batch->count * (slice + 1) / batch->slices;
+        run_async_cases(batch->cases + begin, end - begin);
+    }
+    return NULL;
+}
+
+// async cases wait on one event loop per thread instead of one after another
+static void execute_async(run_context_t* context) {
+    test_runner_t* runner = context->runner;
+    work_list_t* list = &context->async_cases;
+    if (list->count == 0) return;
+    
+    async_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.cases = malloc(list->count * sizeof(test_case_t*));
+    if (batch.cases) {
+        for (size_t i = 0; i < list->count; i++) {
+            batch.cases[i] = list->items[i].test_case;
+        }
+        batch.count = list->count;
+        batch.slices = (size_t)runner->jobs < list->count ? (size_t)runner->jobs : list->count;
+        run_threads((int)batch.slices, async_worker, &batch);
+        free(batch.cases);
+    } else {
+        for (size_t i = 0; i < list->count; i++) {
+            run_test_case(runner, list->items[i].test_case, 1);
+        }
+    }
+    
+    for (size_t i = 0; i < list->count; i++) {
+        work_item_t* item = &list->items[i];
+        context_finish_case(context, item->test_case, item->path_hash, item->suite_path);
+    }
+    work_list_free(list);
+}
+
+// retries go last so a flaky case never holds up the rest of the run
+static void execute_reruns(run_context_t* context) {
+    test_runner_t* runner = context->runner;
+    
+    work_list_t* reruns = &context->reruns;
+    
+    if (runner->jobs > 1 && reruns->count > 1) {
+        work_queue_t queue;
+        memset(&queue, 0, sizeof(queue));
+        queue.context = context;
+        queue.items = reruns->items;
+        queue.count = reruns->count;
+        
+        pthread_mutex_init(&queue.lock, NULL);
+        int threads = (size_t)runner->jobs < queue.count ? runner->jobs : (int)queue.count;
+        run_threads(threads, pool_worker, &queue);
+        pthread_mutex_destroy(&queue.lock);
+    } else {
+        for (size_t i = 0; i < reruns->count; i++) {
+            work_item_t* item = &reruns->items[i];
+            rerun_case(context, item, runner->jobs);
+            context_case_done(context, item->test_case, item->path_hash, item->suite_path);
+        }
+    }
+    work_list_free(reruns);
+}
+
+static void open_cache(test_runner_t* runner) {
+    if (!runner->cache_path) return;
+    
+    runner->cache = cache_open(runner->cache_path);
+    if (!runner->cache) {
+        fprintf(stderr, "Warning: Cannot open result cache %s\n", runner->cache_path);
+    }
+}
+
+static void execute_runner(run_context_t* context) {
+    test_runner_t* runner = context->runner;
+    open_cache(runner);
+    context->batch_async = true;
+    if (runner->jobs == 1) capture_open(runner);
+    
+    run_plan_t plan;
+    if (compile_plan(context, &plan) == 0) {
+        prepare_plan(context, &plan);
+        if (runner->jobs > 1) {
+            execute_parallel(context, &plan);
+        } else {
+            run_plan_range(context, &plan, 0, plan.count, runner->jobs, NULL);
+        }
+        record_plan(runner, &plan);
+    } else {
+        fprintf(stderr, "Warning: Failed to compile the test plan\n");
+    }
+    free_plan(&plan);
+    
+    execute_async(context);
+    execute_reruns(context);
+    tap_finish(context);
+    capture_close();
+}
+
+static void finish_runner(test_runner_t* runner) {
+    if (runner->log_path && test_runner_write_log(runner, runner->log_path) != 0) {
+        fprintf(stderr, "Warning: Failed to write result log %s\n", runner->log_path);
+    }
+    
+    if (runner->cache) {
+        printf("\nCache: %d replayed, %d executed\n", runner->cache->hits, runner->cache->executed);
+        cache_close(runner->cache);
+        runner->cache = NULL;
+    }
+}
+
+int test_runner_load_dir(test_runner_t* runner, const char* directory) {
+    if (!runner || !directory) return -1;
+    
+    DIR* dir = opendir(directory);
+    if (!dir) return -1;
+    
+    char** names = NULL;
+    size_t count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length < 4 || strcmp(entry->d_name + length - 3, ".so") != 0) {
+            continue;
+        }
+        
+        char** new_names = realloc(names, (count + 1) * sizeof(char*));
+        if (!new_names) break;
+        names = new_names;
+        names[count] = strdup(entry->d_name);
+        if (names[count]) count++;
+    }
+    closedir(dir);
+    
+    // registration order, and therefore report order, follows file names
+    qsort(names, count, sizeof(char*), compare_names);
+    
+    int loaded = 0;
+    for (size_t i = 0; i < count; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        
+        void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            fprintf(stderr, "Warning: Cannot load %s: %s\n", path, dlerror());
+            continue;
+        }
+        
+        test_register_func_t register_func;
+        *(void**)(&register_func) = dlsym(handle, UNITTEST_REGISTER_SYMBOL);
+        if (!register_func) {
+            fprintf(stderr, "Warning: %s does not export %s\n", path, UNITTEST_REGISTER_SYMBOL);
+            dlclose(handle);
+            continue;
+        }
+        
+        pthread_mutex_lock(&registration_lock);
+        void** new_modules = realloc(runner->modules, (runner->module_count + 1) * sizeof(void*));
+        if (new_modules) {
+            runner->modules = new_modules;
+            runner->modules[runner->module_count++] = handle;
+        }
+        pthread_mutex_unlock(&registration_lock);
+        if (!new_modules) {
+            dlclose(handle);
+            continue;
+        }
+        
+        if (register_func(runner) != 0) {
+            fprintf(stderr, "Warning: Registration failed in %s\n", path);
+        }
+        loaded++;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return loaded;
+}
+
+#define LOG_MAGIC 0x474C5455u // "UTLG"
+#define LOG_VERSION 1
+#define LOG_BUFFER_SIZE 65536
+
+// a log is a header followed by records; logs may be concatenated, ids
+// restart after every header
+enum {
+    LOG_STRING = 1,     // varint length, bytes
+    LOG_SUITE,          // varint parent suite id (0 for top level), varint name id
+    LOG_CASE            // varint suite id, varint name id, varint flags, varint duration ns,
+                        // varint result count, statuses packed two per byte,
+                        // varint report string id + 1 (0 for none), then with
+                        // LOG_CASE_HISTORY: varint run count, varint flaky run count,
+                        // then with LOG_CASE_DIAGNOSTICS: varint count, and per record
+                        // varint result, file id + 1, line, signal, message id + 1,
+                        // output id + 1
+};
+
+#define LOG_CASE_HISTORY 0x1 // otherwise the record is a single run that was not flaky
+#define LOG_CASE_DIAGNOSTICS 0x2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+} log_header_t;
+
+typedef struct {
+    int fd;
+    unsigned char* buffer;
+    size_t length;
+    bool failed;
+    hash_map_t strings;
+    const char** interned;  // by id, the strings are borrowed from the tree
+    uint64_t string_count;
+    uint64_t string_capacity;
+    uint64_t suite_count;
+} log_writer_t;
+
+static void log_flush(log_writer_t* writer) {
+    size_t written = 0;
+    while (written < writer->length && !writer->failed) {
+        ssize_t result = write(writer->fd, writer->buffer + written, writer->length - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) writer->failed = true;
+        else written += (size_t)result;
+    }
+    writer->length = 0;
+}
+
+// statuses are packed two to a byte, anything out of range is written and
+// read back as a runtime error rather than spilling into its neighbor
+static unsigned char log_status(test_status_t status) {
+    return (unsigned)status <= STATUS_RUNTIME_ERROR ? (unsigned char)status : STATUS_RUNTIME_ERROR;
+}
+
+static void log_put(log_writer_t* writer, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    while (size > 0) {
+        if (writer->length == LOG_BUFFER_SIZE) log_flush(writer);
+        
+        size_t chunk = LOG_BUFFER_SIZE - writer->length;
+        if (chunk > size) chunk = size;
+        memcpy(writer->buffer + writer->length, bytes, chunk);
+        writer->length += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+static void log_put_varint(log_writer_t* writer, uint64_t value) {
+    unsigned char bytes[10];
+    size_t length = 0;
+    do {
+        bytes[length] = (unsigned char)(value & 0x7F);
+        value >>= 7;
+        if (value) bytes[length] |= 0x80;
+        length++;
+    } while (value);
+    log_put(writer, bytes, length);
+}
+
+// names are written once and referenced by id afterwards; a string that
+// only shares the hash of an earlier one is written again under a new id
+static uint64_t log_intern(log_writer_t* writer, const char* string) {
+    uint64_t hash = hash_string(string);
+    void* id = hash_map_get(&writer->strings, hash);
+    if (id && strcmp(writer->interned[(uintptr_t)id - 1], string) == 0) return (uint64_t)(uintptr_t)id - 1;
+    
+    size_t length = strlen(string);
+    unsigned char tag = LOG_STRING;
+    log_put(writer, &tag, 1);
+    log_put_varint(writer, length);
+    log_put(writer, string, length);
+    
+    uint64_t new_id = writer->string_count++;
+    if (id) return new_id;
+    if (new_id >= writer->string_capacity) {
+        uint64_t new_capacity = writer->string_capacity == 0 ? 256 : writer->string_capacity * 2;
+        const char** new_interned = realloc(writer->interned, new_capacity * sizeof(const char*));
+        if (!new_interned) return new_id;
+        writer->interned = new_interned;
+        writer->string_capacity = new_capacity;
+    }
+    writer->interned[new_id] = string;
+    hash_map_put(&writer->strings, hash, (void*)(uintptr_t)(new_id + 1));
+    return new_id;
+}
+
+static void log_write_case(log_writer_t* writer, const test_case_t* test_case, uint64_t suite_id) {
+    uint64_t name = log_intern(writer, test_case->name);
+    uint64_t report = test_case->report ? log_intern(writer, test_case->report) + 1 : 0;
+    
+    // strings go out before the record that refers to them
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    int diagnostic_count = diagnostics ? diagnostics->count : 0;
+    uint64_t* strings = diagnostic_count > 0 ? malloc(diagnostic_count * 3 * sizeof(uint64_t)) : NULL;
+    if (!strings) diagnostic_count = 0;
+    for (int i = 0; i < diagnostic_count; i++) {
+        const test_diagnostic_t* diagnostic = resolve_diagnostic(diagnostics, &diagnostics->records[i]);
+        strings[i * 3] = diagnostic->file ? log_intern(writer, diagnostic->file) + 1 : 0;
+        strings[i * 3 + 1] = diagnostic->message ? log_intern(writer, diagnostic->message) + 1 : 0;
+        strings[i * 3 + 2] = diagnostic->output ? log_intern(writer, diagnostic->output) + 1 : 0;
+    }
+    
+    uint64_t flags = test_case->run_count != 1 || test_case->flaky_count != 0 ? LOG_CASE_HISTORY : 0;
+    if (diagnostic_count > 0) flags |= LOG_CASE_DIAGNOSTICS;
+    
+    unsigned char tag = LOG_CASE;
+    log_put(writer, &tag, 1);
+    log_put_varint(writer, suite_id);
+    log_put_varint(writer, name);
+    log_put_varint(writer, flags);
+    log_put_varint(writer, test_case->duration_ns);
+    log_put_varint(writer, (uint64_t)test_case->result_count);
+    
+    for (int i = 0; i < test_case->result_count; i += 2) {
+        unsigned char packed = log_status(test_case->results[i]) & 0x0F;
+        if (i + 1 < test_case->result_count) {
+            packed |= (unsigned char)((log_status(test_case->results[i + 1]) & 0x0F) << 4);
+        }
+        log_put(writer, &packed, 1);
+    }
+    log_put_varint(writer, report);
+    
+    if (flags & LOG_CASE_HISTORY) {
+        log_put_varint(writer, (uint64_t)test_case->run_count);
+        log_put_varint(writer, (uint64_t)test_case->flaky_count);
+    }
+    
+    if (flags & LOG_CASE_DIAGNOSTICS) {
+        log_put_varint(writer, (uint64_t)diagnostic_count);
+        for (int i = 0; i < diagnostic_count; i++) {
+            const diagnostic_record_t* record = &diagnostics->records[i];
+            log_put_varint(writer, (uint64_t)record->result);
+            log_put_varint(writer, strings[i * 3]);
+            log_put_varint(writer, (uint64_t)record->diagnostic.line);
+            log_put_varint(writer, (uint64_t)record->diagnostic.signal);
+            log_put_varint(writer, strings[i * 3 + 1]);
+            log_put_varint(writer, strings[i * 3 + 2]);
+        }
+    }
+    free(strings);
+}
+
+static void log_write_suite(log_writer_t* writer, const test_suite_t* suite, uint64_t parent_id) {
+    uint64_t name = log_intern(writer, suite->name);
+    uint64_t suite_id = ++writer->suite_count;
+    
+    unsigned char tag = LOG_SUITE;
+    log_put(writer, &tag, 1);
+    log_put_varint(writer, parent_id);
+    log_put_varint(writer, name);
+    
+    for (const test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        log_write_case(writer, current_case, suite_id);
+    }
+    for (const test_suite_t* child = suite->child_suites; child; child = child->next) {
+        log_write_suite(writer, child, suite_id);
+    }
+}
+
+int test_runner_write_log(test_runner_t* runner, const char* path) {
+    if (!runner || !path) return -1;
+    
+    log_writer_t writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.buffer = malloc(LOG_BUFFER_SIZE);
+    if (!writer.buffer || hash_map_init(&writer.strings, 256) != 0) {
+        free(writer.buffer);
+        return -1;
+    }
+    
+    writer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer.fd < 0) {
+        hash_map_free(&writer.strings);
+        free(writer.buffer);
+        return -1;
+    }
+    
+    log_header_t header = { LOG_MAGIC, LOG_VERSION, 0 };
+    log_put(&writer, &header, sizeof(header));
+    for (const test_suite_t* suite = runner->root_suite; suite; suite = suite->next) {
+        log_write_suite(&writer, suite, 0);
+    }
+    log_flush(&writer);
+    
+    bool failed = writer.failed;
+    if (close(writer.fd) != 0) failed = true;
+    hash_map_free(&writer.strings);
+    free(writer.interned);
+    free(writer.buffer);
+    return failed ? -1 : 0;
+}
+
+typedef struct {
+    const unsigned char* cursor;
+    const unsigned char* end;
+    bool failed;
+} log_reader_t;
+
+static uint64_t log_get_varint(log_reader_t* reader) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->cursor >= reader->end) break;
+        
+        unsigned char byte = *reader->cursor++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    reader->failed = true;
+    return 0;
+}
+
+typedef struct {
+    const char* data;
+    size_t length;
+} log_string_t;
+
+typedef struct {
+    test_suite_t* suite;
+    uint64_t path_hash;
+} log_suite_t;
+
+typedef struct {
+    test_runner_t* runner;
+    struct path_index* index;   // the runner's, new nodes are added
+    log_string_t* strings;
+    size_t string_count;
+    size_t string_capacity;
+    log_suite_t* log_suites;
+    size_t suite_count;
+    size_t suite_capacity;
+} log_merge_t;
+
+static const log_string_t* merge_string(log_merge_t* merge, uint64_t id) {
+    return id < merge->string_count ? &merge->strings[id] : NULL;
+}
+
+static int merge_suite_record(log_merge_t* merge, log_reader_t* reader) {
+    uint64_t parent_id = log_get_varint(reader);
+    const log_string_t* name = merge_string(merge, log_get_varint(reader));
+    if (reader->failed || !name || parent_id > merge->suite_count) return -1;
+    
+    log_suite_t* parent = parent_id > 0 ? &merge->log_suites[parent_id - 1] : NULL;
+    uint64_t path_hash = path_hash_extend_n(parent ? parent->path_hash : PATH_HASH_ROOT,
+                                            name->data, name->length);
+    
+    // suites seen in an earlier log or registered in the runner are reused,
+    // the parent record already matched its own suite by name
+    uint64_t parent_hash = parent ? parent->path_hash : PATH_HASH_ROOT;
+    const path_entry_t* entry = hash_map_get(&merge->index->suites, path_hash);
+    if (entry && (!entry->node || !path_entry_named(entry, parent_hash, name->data, name->length))) {
+        fprintf(stderr, "Warning: Suite %.*s shares a path hash with another path\n", (int)name->length,
+                name->data);
+        return -1;
+    }
+    
+    test_suite_t* suite = entry ? entry->node : NULL;
+    if (!suite) {
+        const char* suite_name = intern_name_n(name->data, name->length);
+        suite = suite_name ? test_suite_create(suite_name) : NULL;
+        if (!suite || path_index_put(merge->index, &merge->index->suites, path_hash, suite, parent_hash,
+                                     suite->name) != 0) {
+            test_suite_destroy(suite);
+            return -1;
+        }
+        
+        if (parent) test_suite_add_child(parent->suite, suite);
+        else test_runner_add_suite(merge->runner, suite);
+    }
+    
+    if (merge->suite_count >= merge->suite_capacity) {
+        size_t new_capacity = merge->suite_capacity == 0 ? 64 : merge->suite_capacity * 2;
+        log_suite_t* new_suites = realloc(merge->log_suites, new_capacity * sizeof(log_suite_t));
+        if (!new_suites) return -1;
+        merge->log_suites = new_suites;
+        merge->suite_capacity = new_capacity;
+    }
+    merge->log_suites[merge->suite_count].suite = suite;
+    merge->log_suites[merge->suite_count].path_hash = path_hash;
+    merge->suite_count++;
+    return 0;
+}
+
+static int merge_case_record(log_merge_t* merge, log_reader_t* reader) {
+    uint64_t suite_id = log_get_varint(reader);
+    const log_string_t* name = merge_string(merge, log_get_varint(reader));
+    uint64_t flags = log_get_varint(reader);
+    uint64_t duration = log_get_varint(reader);
+    uint64_t count = log_get_varint(reader);
+    if (reader->failed || !name || suite_id == 0 || suite_id > merge->suite_count ||
+        count > INT_MAX || (count + 1) / 2 > (uint64_t)(reader->end - reader->cursor)) {
+        return -1;
+    }
+    
+    log_suite_t* parent = &merge->log_suites[suite_id - 1];
+    uint64_t path_hash = path_hash_extend_n(parent->path_hash, name->data, name->length);
+    const path_entry_t* entry = hash_map_get(&merge->index->cases, path_hash);
+    if (entry && (!entry->node || !path_entry_named(entry, parent->path_hash, name->data, name->length))) {
+        fprintf(stderr, "Warning: Case %.*s shares a path hash with another path\n", (int)name->length,
+                name->data);
+        return -1;
+    }
+    
+    test_case_t* test_case = entry ? entry->node : NULL;
+    if (!test_case) {
+        const char* case_name = intern_name_n(name->data, name->length);
+        test_case = case_name ? test_case_create(case_name, NULL) : NULL;
+        if (!test_case || path_index_put(merge->index, &merge->index->cases, path_hash, test_case,
+                                         parent->path_hash, test_case->name) != 0) {
+            test_case_destroy(test_case);
+            return -1;
+        }
+        test_suite_add_test_case(parent->suite, test_case);
+    }
+    
+    // results of the same case from several shards are concatenated
+    int base = test_case->result_count;
+    if (reserve_results(test_case, test_case->result_count + (int)count) != 0) return -1;
+    const unsigned char* packed = reader->cursor;
+    for (uint64_t i = 0; i < count; i++) {
+        unsigned char status = (packed[i / 2] >> ((i & 1) * 4)) & 0x0F;
+        test_case->results[test_case->result_count++] = (test_status_t)log_status(status);
+    }
+    reader->cursor += (count + 1) / 2;
+    test_case->duration_ns += duration;
+    
+    uint64_t report = log_get_varint(reader);
+    uint64_t runs = 1;
+    uint64_t flaky = 0;
+    if (flags & LOG_CASE_HISTORY) {
+        runs = log_get_varint(reader);
+        flaky = log_get_varint(reader);
+    }
+    if (reader->failed || runs > INT_MAX || flaky > runs) return -1;
+    test_case->run_count += (int)runs;
+    test_case->flaky_count += (int)flaky;
+    
+    if (report > 0) {
+        const log_string_t* text = merge_string(merge, report - 1);
+        char* copy = text ? strndup(text->data, text->length) : NULL;
+        if (copy) {
+            free(test_case->report);
+            test_case->report = copy;
+        }
+    }
+    
+    uint64_t diagnostic_count = flags & LOG_CASE_DIAGNOSTICS ? log_get_varint(reader) : 0;
+    for (uint64_t i = 0; i < diagnostic_count && !reader->failed; i++) {
+        uint64_t result = log_get_varint(reader);
+        uint64_t ids[3];
+        ids[0] = log_get_varint(reader);
+        uint64_t line = log_get_varint(reader);
+        uint64_t signal = log_get_varint(reader);
+        ids[1] = log_get_varint(reader);
+        ids[2] = log_get_varint(reader);
+        if (reader->failed || result >= count || line > INT_MAX || signal > INT_MAX) return -1;
+        
+        char* texts[3] = { NULL, NULL, NULL };
+        for (int j = 0; j < 3; j++) {
+            const log_string_t* text = ids[j] > 0 ? merge_string(merge, ids[j] - 1) : NULL;
+            if (text) texts[j] = strndup(text->data, text->length);
+        }
+        test_diagnostic_t diagnostic = { texts[1], texts[0], (int)line, (int)signal, texts[2] };
+        test_case_add_diagnostic(test_case, base + (int)result, &diagnostic);
+        for (int j = 0; j < 3; j++) {
+            free(texts[j]);
+        }
+    }
+    return reader->failed ? -1 : 0;
+}
+
+static int merge_log(log_merge_t* merge, const unsigned char* data, size_t size) {
+    log_reader_t reader = { data, data + size, false };
+    
+    while (reader.cursor < reader.end) {
+        unsigned char tag = *reader.cursor;
+        if (tag == (LOG_MAGIC & 0xFF)) {
+            log_header_t header;
+            if ((size_t)(reader.end - reader.cursor) < sizeof(header)) return -1;
+            memcpy(&header, reader.cursor, sizeof(header));
+            if (header.magic != LOG_MAGIC || header.version != LOG_VERSION) return -1;
+            
+            reader.cursor += sizeof(header);
+            merge->string_count = 0;
+            merge->suite_count = 0;
+            continue;
+        }
+        reader.cursor++;
+        
+        int status = -1;
+        if (tag == LOG_STRING) {
+            uint64_t length = log_get_varint(&reader);
+            if (reader.failed || length > (uint64_t)(reader.end - reader.cursor)) return -1;
+            
+            if (merge->string_count >= merge->string_capacity) {
+                size_t new_capacity = merge->string_capacity == 0 ? 256 : merge->string_capacity * 2;
+                log_string_t* new_strings = realloc(merge->strings, new_capacity * sizeof(log_string_t));
+                if (!new_strings) return -1;
+                merge->strings = new_strings;
+                merge->string_capacity = new_capacity;
+            }
+            merge->strings[merge->string_count].data = (const char*)reader.cursor;
+            merge->strings[merge->string_count].length = (size_t)length;
+            merge->string_count++;
+            reader.cursor += length;
+            status = 0;
+        } else if (tag == LOG_SUITE) {
+            status = merge_suite_record(merge, &reader);
+        } else if (tag == LOG_CASE) {
+            status = merge_case_record(merge, &reader);
+        }
+        if (status != 0) return -1;
+    }
+    return 0;
+}
+
+int test_runner_load_log(test_runner_t* runner, const char* path) {
+    if (!runner || !path) return -1;
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(log_header_t)) {
+        close(fd);
+        return -1;
+    }
+    
+    size_t size = (size_t)info.st_size;
+    const unsigned char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    
+    log_merge_t merge;
+    memset(&merge, 0, sizeof(merge));
+    merge.runner = runner;
+    int status = -1;
+    
+    // the index is kept, so joining many logs maps the tree only once
+    pthread_mutex_lock(&registration_lock);
+    struct path_index* index = magic == LOG_MAGIC ? update_path_index(runner) : NULL;
+    pthread_mutex_unlock(&registration_lock);
+    if (index) {
+        merge.index = index;
+        status = merge_log(&merge, data, size);
+        
+        // everything the merge added is indexed already
+        pthread_mutex_lock(&registration_lock);
+        if (status == 0) index->generation = tree_generation;
+        pthread_mutex_unlock(&registration_lock);
+    }
+    
+    free(merge.strings);
+    free(merge.log_suites);
+    munmap((void*)data, size);
+    return status;
+}
+
+static void map_suite_cases(hash_map_t* map, test_suite_t* suite, uint64_t parent_hash) {
+    uint64_t suite_hash = path_hash_extend(parent_hash, suite->name);
+    for (test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        hash_map_put(map, path_hash_extend(suite_hash, current_case->name), current_case);
+    }
+    for (test_suite_t* child = suite->child_suites; child; child = child->next) {
+        map_suite_cases(map, child, suite_hash);
+    }
+}
+
+static size_t count_suite_cases(const test_suite_t* suite) {
+    size_t count = 0;
+    for (const test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        count++;
+    }
+    for (const test_suite_t* child = suite->child_suites; child; child = child->next) {
+        count += count_suite_cases(child);
+    }
+    return count;
+}
+
+#define DIFF_MIN_DELTA_NS 100000ULL // timing noise below 0.1 ms is never reported
+
+// ordered by impact, worst last
+typedef enum {
+    DIFF_TIMING,
+    DIFF_REMOVED,
+    DIFF_ADDED,
+    DIFF_STATUS,
+    DIFF_REGRESSION
+} diff_kind_t;
+
+typedef struct {
+    const char* name;
+    const test_case_t* before;
+    const test_case_t* after;
+    diff_kind_t kind;
+    bool timing_changed;
+    uint64_t delta_ns;
+} diff_entry_t;
+
+typedef struct diff_node {
+    const char* name;
+    struct diff_node* parent;
+    struct diff_node** children;
+    size_t child_count;
+    size_t child_capacity;
+    diff_entry_t* entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    
+    // subtree totals used for sorting and the summary column
+    diff_kind_t kind;
+    uint64_t delta_ns;
+    int status_changes;
+    int timing_changes;
+} diff_node_t;
+
+// suites on the current path, only turned into nodes once something below them changed
+typedef struct diff_frame {
+    const struct diff_frame* parent;
+    const test_suite_t* suite;
+    uint64_t hash;
+} diff_frame_t;
+
+typedef struct {
+    hash_map_t nodes;
+    const hash_map_t* other;
+    diff_node_t root;
+    double threshold;
+    bool removed_only;
+    size_t matched;
+    int changes;
+    int failed;
+} diff_t;
+
+static int count_failures(const test_case_t* test_case) {
+    int count = 0;
+    for (int i = 0; i < test_case->result_count; i++) {
+        count += status_is_failure(test_case->results[i]);
+    }
+    return count;
+}
+
+static bool diff_classify(const diff_t* diff, diff_entry_t* entry) {
+    const test_case_t* before = entry->before;
+    const test_case_t* after = entry->after;
+    
+    if (!before || !after) {
+        entry->kind = before ? DIFF_REMOVED : DIFF_ADDED;
+        if (after && count_failures(after) > 0) entry->kind = DIFF_REGRESSION;
+        return true;
+    }
+    
+    uint64_t delta = after->duration_ns > before->duration_ns ?
+                     after->duration_ns - before->duration_ns :
+                     before->duration_ns - after->duration_ns;
+    entry->delta_ns = delta;
+    entry->timing_changed = delta >= DIFF_MIN_DELTA_NS &&
+                            (double)delta > diff->threshold * (double)before->duration_ns;
+    
+    bool status_changed = before->result_count != after->result_count ||
+                          memcmp(before->results, after->results,
+                                 sizeof(test_status_t) * after->result_count) != 0;
+    if (status_changed) {
+        entry->kind = count_failures(after) > count_failures(before) ? DIFF_REGRESSION : DIFF_STATUS;
+    } else {
+        entry->kind = DIFF_TIMING;
+    }
+    return status_changed || entry->timing_changed;
+}
+
+static diff_node_t* diff_node(diff_t* diff, const diff_frame_t* frame) {
+    if (!frame) return &diff->root;
+    
+    diff_node_t* node = hash_map_get(&diff->nodes, frame->hash);
+    if (node) return node;
+    
+    diff_node_t* parent = diff_node(diff, frame->parent);
+    if (!parent) return NULL;
+    
+    if (parent->child_count == parent->child_capacity) {
+        size_t capacity = parent->child_capacity ? parent->child_capacity * 2 : 4;
+        diff_node_t** children = realloc(parent->children, capacity * sizeof(diff_node_t*));
+        if (!children) return NULL;
+        parent->children = children;
+        parent->child_capacity = capacity;
+    }
+    
+    node = calloc(1, sizeof(diff_node_t));
+    if (!node) return NULL;
+    if (hash_map_put(&diff->nodes, frame->hash, node) != 0) {
+        free(node);
+        return NULL;
+    }
+    
+    node->name = frame->suite->name;
+    node->parent = parent;
+    parent->children[parent->child_count++] = node;
+    return node;
+}
+
+static void diff_add(diff_t* diff, const diff_frame_t* frame, const diff_entry_t* entry) {
+    diff_node_t* node = diff_node(diff, frame);
+    if (!node) {
+        diff->failed = 1;
+        return;
+    }
+    
+    if (node->entry_count == node->entry_capacity) {
+        size_t capacity = node->entry_capacity ? node->entry_capacity * 2 : 4;
+        diff_entry_t* entries = realloc(node->entries, capacity * sizeof(diff_entry_t));
+        if (!entries) {
+            diff->failed = 1;
+            return;
+        }
+        node->entries = entries;
+        node->entry_capacity = capacity;
+    }
+    node->entries[node->entry_count++] = *entry;
+    diff->changes++;
+    
+    for (; node; node = node->parent) {
+        if (entry->kind > node->kind) node->kind = entry->kind;
+        node->delta_ns += entry->delta_ns;
+        node->status_changes += entry->kind != DIFF_TIMING;
+        node->timing_changes += entry->timing_changed;
+    }
+}
+
+// walks one tree and joins every case against the other tree's cases by path hash
+static void diff_suite(diff_t* diff, const test_suite_t* suite, const diff_frame_t* parent) {
+    diff_frame_t frame;
+    frame.parent = parent;
+    frame.suite = suite;
+    frame.hash = path_hash_extend(parent ? parent->hash : PATH_HASH_ROOT, suite->name);
+    
+    for (const test_case_t* current_case = suite->test_cases; current_case; current_case = current_case->next) {
+        const test_case_t* other = hash_map_get(diff->other, path_hash_extend(frame.hash, current_case->name));
+        if (other && other->name != current_case->name) other = NULL;  // interned, only the hash matched
+        if (diff->removed_only && other) continue;
+        if (other) diff->matched++;
+        
+        diff_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.name = current_case->name;
+        entry.before = diff->removed_only ? current_case : other;
+        entry.after = diff->removed_only ? NULL : current_case;
+        if (diff_classify(diff, &entry)) {
+            diff_add(diff, &frame, &entry);
+        }
+    }
+    
+    for (const test_suite_t* child = suite->child_suites; child; child = child->next) {
+        diff_suite(diff, child, &frame);
+    }
+}
+
+static int compare_diff_nodes(const void* a, const void* b) {
+    const diff_node_t* x = *(const diff_node_t* const*)a;
+    const diff_node_t* y = *(const diff_node_t* const*)b;
+    if (x->kind != y->kind) return x->kind > y->kind ? -1 : 1;
+    if (x->delta_ns != y->delta_ns) return x->delta_ns > y->delta_ns ? -1 : 1;
+    return 0;
+}
+
+static int compare_diff_entries(const void* a, const void* b) {
+    const diff_entry_t* x = a;
+    const diff_entry_t* y = b;
+    if (x->kind != y->kind) return x->kind > y->kind ? -1 : 1;
+    if (x->delta_ns != y->delta_ns) return x->delta_ns > y->delta_ns ? -1 : 1;
+    return 0;
+}
+
+static void diff_free(diff_node_t* node) {
+    for (size_t i = 0; i < node->child_count; i++) {
+        diff_free(node->children[i]);
+        free(node->children[i]);
+    }
+    free(node->children);
+    free(node->entries);
+}
+
+static void format_duration(uint64_t ns, char* buffer, size_t size) {
+    if (ns >= 1000000000ULL) {
+        snprintf(buffer, size, "%.2fs", ns / 1e9);
+    } else if (ns >= 1000000ULL) {
+        snprintf(buffer, size, "%.2fms", ns / 1e6);
+    } else if (ns >= 1000ULL) {
+        snprintf(buffer, size, "%.1fus", ns / 1e3);
+    } else {
+        snprintf(buffer, size, "%" PRIu64 "ns", ns);
+    }
+}
+
+static void print_diff_entry(const diff_entry_t* entry, const char* prefix, bool is_last) {
+    printf("%s%s─%s: ", prefix, is_last ? "└" : "├", entry->name);
+    
+    if (entry->kind != DIFF_TIMING) {
+        if (entry->before) {
+            print_results(entry->before);
+        } else {
+            printf("(new) ");
+        }
+        printf("→ ");
+        if (entry->after) {
+            print_results(entry->after);
+        } else {
+            printf("(removed) ");
+        }
+    } else {
+        print_results(entry->after);
+    }
+    
+    if (entry->timing_changed) {
+        char before[32];
+        char after[32];
+        format_duration(entry->before->duration_ns, before, sizeof(before));
+        format_duration(entry->after->duration_ns, after, sizeof(after));
+        bool slower = entry->after->duration_ns > entry->before->duration_ns;
+        printf(" %s%s → %s", slower ? palette->red : palette->green, before, after);
+        if (entry->before->duration_ns > 0) {
+            printf(" (%+.0f%%)", 100.0 * ((double)entry->after->duration_ns -
+                                          (double)entry->before->duration_ns) /
+                                 (double)entry->before->duration_ns);
+        }
+        printf("%s", palette->reset);
+    }
+    printf("\n");
+}
+
+static void print_diff_node(tree_render_t* render, diff_node_t* node, bool is_last);
+
+// most impactful changes first
+static void print_diff_children(tree_render_t* render, diff_node_t* node) {
+    if (node->child_count > 1) {
+        qsort(node->children, node->child_count, sizeof(diff_node_t*), compare_diff_nodes);
+    }
+    if (node->entry_count > 1) {
+        qsort(node->entries, node->entry_count, sizeof(diff_entry_t), compare_diff_entries);
+    }
+    
+    for (size_t i = 0; i < node->child_count; i++) {
+        print_diff_node(render, node->children[i], i + 1 == node->child_count && node->entry_count == 0);
+    }
+    for (size_t i = 0; i < node->entry_count; i++) {
+        print_diff_entry(&node->entries[i], render->prefix, i + 1 == node->entry_count);
+    }
+}
+
+static void print_diff_node(tree_render_t* render, diff_node_t* node, bool is_last) {
+    printf("%s%s─%s", render->prefix, is_last ? "└" : "├", node->name);
+    
+    int padding = 50 - (int)render->length - (int)strlen(node->name) - 2;
+    if (padding < 1) padding = 1;
+    printf("%*s", padding, "");
+    printf("status: %s%2d%s  timing: %s%2d%s\n",
+           node->status_changes ? palette->red : palette->gray, node->status_changes, palette->reset,
+           node->timing_changes ? palette->yellow : palette->gray, node->timing_changes, palette->reset);
+    
+    size_t length = render->length;
+    if (render_push(render, is_last) != 0) return;
+    print_diff_children(render, node);
+    render_pop(render, length);
+}
+
+int print_test_diff(test_runner_t* before, test_runner_t* after, double threshold) {
+    if (!before || !after) return -1;
+    
+    size_t before_count = 0;
+    size_t after_count = 0;
+    for (test_suite_t* suite = before->root_suite; suite; suite = suite->next) {
+        before_count += count_suite_cases(suite);
+    }
+    for (test_suite_t* suite = after->root_suite; suite; suite = suite->next) {
+        after_count += count_suite_cases(suite);
+    }
+    
+    hash_map_t before_cases;
+    hash_map_t after_cases;
+    diff_t diff;
+    memset(&before_cases, 0, sizeof(before_cases));
+    memset(&after_cases, 0, sizeof(after_cases));
+    memset(&diff, 0, sizeof(diff));
+    diff.threshold = threshold;
+    
+    int status = -1;
+    if (hash_map_init(&before_cases, before_count) == 0 && hash_map_init(&diff.nodes, 64) == 0) {
+        for (test_suite_t* suite = before->root_suite; suite; suite = suite->next) {
+            map_suite_cases(&before_cases, suite, PATH_HASH_ROOT);
+        }
+        
+        diff.other = &before_cases;
+        for (test_suite_t* suite = after->root_suite; suite; suite = suite->next) {
+            diff_suite(&diff, suite, NULL);
+        }
+        
+        // only a second join when some cases of the old run were never matched
+        if (diff.matched < before_count) {
+            if (hash_map_init(&after_cases, after_count) == 0) {
+                for (test_suite_t* suite = after->root_suite; suite; suite = suite->next) {
+                    map_suite_cases(&after_cases, suite, PATH_HASH_ROOT);
+                }
+                diff.other = &after_cases;
+                diff.removed_only = true;
+                for (test_suite_t* suite = before->root_suite; suite; suite = suite->next) {
+                    diff_suite(&diff, suite, NULL);
+                }
+            } else {
+                diff.failed = 1;
             }
         }
-        current_case = current_case->next;
+        
+        if (!diff.failed) {
+            status = diff.changes;
+        }
     }
+    hash_map_free(&before_cases);
+    hash_map_free(&after_cases);
+    hash_map_free(&diff.nodes);
     
-    test_suite_t* current_suite = suite->child_suites;
-    while (current_suite) {
-        calculate_suite_stats(current_suite);
-        suite->stats.success_count += current_suite->stats.success_count;
-        suite->stats.unexpected_output_count += current_suite->stats.unexpected_output_count;
-        suite->stats.expected_build_error_count += current_suite->stats.expected_build_error_count;
-        suite->stats.build_error_count += current_suite->stats.build_error_count;
-        suite->stats.expected_runtime_error_count += current_suite->stats.expected_runtime_error_count;
-        suite->stats.runtime_error_count += current_suite->stats.runtime_error_count;
-        current_suite = current_suite->next;
+    select_rendering(after);
+    tree_render_t render;
+    memset(&render, 0, sizeof(render));
+    render.capacity = 64;
+    render.prefix = malloc(render.capacity);
+    if (!render.prefix) status = -1;
+    
+    if (status > 0) {
+        render.prefix[0] = '\0';
+        print_legend();
+        print_diff_children(&render, &diff.root);
+        printf("\n%d status changes, %d timing changes\n",
+               diff.root.status_changes, diff.root.timing_changes);
+    } else if (status == 0) {
+        printf("No changes\n");
     }
+    
+    free(render.prefix);
+    diff_free(&diff.root);
+    return status;
 }
 
-void print_legend(void) {
-    printf("%sK%s - success                %sK%s - unexpected output\n",
-           ANSI_GREEN, ANSI_RESET, ANSI_YELLOW, ANSI_RESET);
-    printf("%sB%s - expected build error   %sB%s - build error\n",
-           ANSI_GRAY, ANSI_RESET, ANSI_RED, ANSI_RESET);
-    printf("%sR%s - expected runtime error %sR%s - runtime error\n",
-           ANSI_GRAY, ANSI_RESET, ANSI_RED, ANSI_RESET);
-    printf("\n");
+#define WORKER_ENV "UNITTEST_WORKER_FD"
+#define WORKER_MAX_BATCH 4096
+#define WORKER_TARGET_BATCH_NS 50000000ULL
+
+// wire format: a fixed header followed by length bytes of payload, in host
+// byte order since both ends run on the same machine
+enum {
+    MESSAGE_BATCH = 1,      // uint32 count, count x uint64 path hash
+    MESSAGE_RESULT,         // uint64 path hash, uint64 duration, uint32 count, uint32 report length,
+                            // uint32 diagnostic count, uint32 diagnostics length, statuses,
+                            // report, diagnostics (header, then file, message and output)
+    MESSAGE_BATCH_DONE,
+    MESSAGE_SHUTDOWN
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;
+} message_header_t;
+
+typedef struct {
+    uint64_t path_hash;
+    uint64_t duration_ns;
+    uint32_t result_count;
+    uint32_t report_length;
+    uint32_t diagnostic_count;
+    uint32_t diagnostic_length;
+} result_message_t;
+
+typedef struct {
+    int32_t result;
+    int32_t line;
+    int32_t signal;
+    uint32_t file_length;
+    uint32_t message_length;
+    uint32_t output_length;
+} diagnostic_message_t;
+
+static int send_full(int fd, const void* data, size_t size) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return -1;
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return 0;
 }
 
-static void print_stats(const test_stats_t* stats) {
-    printf("K: %s%2d%s/%s%d%s  B: %s%2d%s/%s%d%s  R: %s%2d%s/%s%d%s",
-           ANSI_GREEN, stats->success_count, ANSI_RESET,
-           ANSI_YELLOW, stats->unexpected_output_count, ANSI_RESET,
-           ANSI_GRAY, stats->expected_build_error_count, ANSI_RESET,
-           ANSI_RED, stats->build_error_count, ANSI_RESET,
-           ANSI_GRAY, stats->expected_runtime_error_count, ANSI_RESET,
-           ANSI_RED, stats->runtime_error_count, ANSI_RESET);
+static int recv_full(int fd, void* data, size_t size) {
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return -1;
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return 0;
 }
 
-static void print_tree_node(test_suite_t* suite, const char* prefix, bool is_last, int depth) {
-    if (!suite) return;
+static int send_message(int fd, uint32_t type, const void* payload, uint32_t length) {
+    message_header_t header = { type, length };
+    if (send_full(fd, &header, sizeof(header)) != 0) return -1;
+    return length > 0 ? send_full(fd, payload, length) : 0;
+}
+
+static int send_result(int fd, const test_case_t* test_case, uint64_t path_hash) {
+    result_message_t result;
+    result.path_hash = path_hash;
+    result.duration_ns = test_case->duration_ns;
+    result.result_count = (uint32_t)test_case->result_count;
+    result.report_length = test_case->report ? (uint32_t)strlen(test_case->report) : 0;
     
-    // current suite
-    printf("%s%s─%s", prefix, is_last ? "└" : "├", suite->name);
+    struct test_diagnostics* diagnostics = test_case->diagnostics;
+    result.diagnostic_count = diagnostics ? (uint32_t)diagnostics->count : 0;
+    result.diagnostic_length = 0;
+    for (uint32_t i = 0; i < result.diagnostic_count; i++) {
+        const test_diagnostic_t* diagnostic = resolve_diagnostic(diagnostics, &diagnostics->records[i]);
+        result.diagnostic_length += sizeof(diagnostic_message_t) +
+            (diagnostic->file ? strlen(diagnostic->file) : 0) +
+            (diagnostic->message ? strlen(diagnostic->message) : 0) +
+            (diagnostic->output ? strlen(diagnostic->output) : 0);
+    }
     
-    // padding and stats
-    int name_len = strlen(suite->name);
-    int padding = 50 - strlen(prefix) - name_len - 2; // 2 for tree chars
-    if (padding < 1) padding = 1;
+    size_t length = sizeof(result) + result.result_count + result.report_length + result.diagnostic_length;
+    unsigned char* payload = malloc(length);
+    if (!payload) return -1;
     
-    for (int i = 0; i < padding; i++) {
-        printf(" ");
+    memcpy(payload, &result, sizeof(result));
+    unsigned char* cursor = payload + sizeof(result);
+    for (uint32_t i = 0; i < result.result_count; i++) {
+        *cursor++ = (unsigned char)test_case->results[i];
+    }
+    if (result.report_length > 0) {
+        memcpy(cursor, test_case->report, result.report_length);
+        cursor += result.report_length;
+    }
+    for (uint32_t i = 0; i < result.diagnostic_count; i++) {
+        const diagnostic_record_t* record = &diagnostics->records[i];
+        const char* texts[3] = { record->diagnostic.file, record->diagnostic.message, record->diagnostic.output };
+        diagnostic_message_t header = {
+            record->result, record->diagnostic.line, record->diagnostic.signal,
+            texts[0] ? (uint32_t)strlen(texts[0]) : 0,
+            texts[1] ? (uint32_t)strlen(texts[1]) : 0,
+            texts[2] ? (uint32_t)strlen(texts[2]) : 0
+        };
+        memcpy(cursor, &header, sizeof(header));
+        cursor += sizeof(header);
+        
+        uint32_t lengths[3] = { header.file_length, header.message_length, header.output_length };
+        for (int j = 0; j < 3; j++) {
+            if (lengths[j] > 0) memcpy(cursor, texts[j], lengths[j]);
+            cursor += lengths[j];
+        }
     }
     
-    print_stats(&suite->stats);
-    printf("\n");
+    int status = send_message(fd, MESSAGE_RESULT, payload, (uint32_t)length);
+    free(payload);
+    return status;
+}
+
+// worker side: run whatever batches arrive until told to stop
+static void serve_worker(test_runner_t* runner, int fd) {
+    pthread_mutex_lock(&registration_lock);
+    struct path_index* index = update_path_index(runner);
+    pthread_mutex_unlock(&registration_lock);
+    if (!index) return;
     
-    // this is clunky, but it works
-    char new_prefix[256];
-    snprintf(new_prefix, sizeof(new_prefix), "%s%s ", prefix, is_last ? " " : "│");
+    uint64_t* batch = NULL;
+    test_case_t** async_cases = NULL;
+    capture_open(runner);
+    message_header_t header;
+    while (recv_full(fd, &header, sizeof(header)) == 0 && header.type == MESSAGE_BATCH) {
+        uint64_t* new_batch = realloc(batch, header.length);
+        if (!new_batch || recv_full(fd, new_batch, header.length) != 0) {
+            free(new_batch);
+            batch = NULL;
+            break;
+        }
+        batch = new_batch;
+        
+        uint32_t batch_count;
+        memcpy(&batch_count, batch, sizeof(batch_count));
+        const unsigned char* hashes = (const unsigned char*)batch + sizeof(uint32_t);
+        
+        // async cases of a batch share one event loop, results still go out in order
+        test_case_t** new_async = realloc(async_cases, (batch_count + 1) * sizeof(test_case_t*));
+        bool batch_async = new_async != NULL;
+        if (batch_async) {
+            async_cases = new_async;
+            size_t async_count = 0;
+            for (uint32_t i = 0; i < batch_count; i++) {
+                uint64_t hash;
+                memcpy(&hash, hashes + i * sizeof(uint64_t), sizeof(hash));
+                test_case_t* test_case = path_index_get(index, &index->cases, hash);
+                if (test_case && test_case->kind == TEST_KIND_ASYNC) {
+                    if (test_case->attempts > 0) reset_case_results(test_case);
+                    async_cases[async_count++] = test_case;
+                }
+            }
+            run_async_cases(async_cases, async_count);
+        }
+        
+        for (uint32_t i = 0; i < batch_count; i++) {
+            uint64_t hash;
+            memcpy(&hash, hashes + i * sizeof(uint64_t), sizeof(hash));
+            
+            test_case_t* test_case = path_index_get(index, &index->cases, hash);
+            if (!test_case) {
+                // unknown to this binary, answer with an empty result
+                test_case_t missing;
+                memset(&missing, 0, sizeof(missing));
+                test_status_t status = STATUS_BUILD_ERROR;
+                missing.results = &status;
+                missing.result_count = 1;
+                missing.report = "case is not registered in the worker";
+                if (send_result(fd, &missing, hash) != 0) goto done;
+                continue;
+            }
+            
+            if (!batch_async || test_case->kind != TEST_KIND_ASYNC) {
+                // a retry may land on the worker that ran the previous attempt
+                if (test_case->attempts > 0) reset_case_results(test_case);
+                run_test_case(runner, test_case, 1);
+            }
+            fflush(stdout);
+            fflush(stderr);
+            if (send_result(fd, test_case, hash) != 0) goto done;
+        }
+        
+        if (send_message(fd, MESSAGE_BATCH_DONE, NULL, 0) != 0) break;
+    }
+
+done:
+    capture_close();
+    free(batch);
+    free(async_cases);
+}
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    size_t* batch;
+    size_t batch_count;
+    size_t batch_done;
+    size_t batch_size;
+    uint64_t batch_start;
+} worker_t;
+
+typedef struct {
+    run_context_t* context;
+    work_queue_t queue;
+    size_t* retry;
+    size_t retry_count;
+    size_t* reruns;
+    size_t rerun_count;
+    worker_t* workers;
+    int worker_count;
+    char* const* worker_argv;
+    int respawns;
+} coordinator_t;
+
+static int spawn_worker(coordinator_t* coordinator, worker_t* worker) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
     
-    // child suites
-    test_suite_t* current_suite = suite->child_suites;
-    while (current_suite) {
-        bool is_last_suite = (current_suite->next == NULL);
-        print_tree_node(current_suite, new_prefix, is_last_suite, depth + 1);
-        current_suite = current_suite->next;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
     }
     
-    test_case_t* current_case = suite->test_cases;
-    while (current_case) {
-        bool is_last_case = (current_case->next == NULL && suite->child_suites == NULL);
+    if (pid == 0) {
+        close(fds[0]);
+        if (coordinator->worker_argv) {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", fds[1]);
+            setenv(WORKER_ENV, value, 1);
+            execvp(coordinator->worker_argv[0], coordinator->worker_argv);
+            _exit(127);
+        }
         
-        printf("%s%s─%s: ", new_prefix, is_last_case ? "└" : "├", current_case->name);
+        // forked workers already have the registered tree
+        serve_worker(coordinator->context->runner, fds[1]);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+    
+    close(fds[1]);
+    worker->pid = pid;
+    worker->fd = fds[0];
+    worker->batch_count = 0;
+    worker->batch_done = 0;
+    worker->batch_size = 1;
+    return 0;
+}
+
+static size_t coordinator_remaining(const coordinator_t* coordinator) {
+    return coordinator->retry_count + (coordinator->queue.count - coordinator->queue.next) +
+           coordinator->rerun_count;
+}
+
+// batches of lost workers first, then the queue, failed cases get their retries last
+static size_t coordinator_next(coordinator_t* coordinator) {
+    if (coordinator->retry_count > 0) return coordinator->retry[--coordinator->retry_count];
+    if (coordinator->queue.next < coordinator->queue.count) return coordinator->queue.next++;
+    return coordinator->reruns[--coordinator->rerun_count];
+}
+
+// guided self-scheduling, capped by what this worker finishes in ~50ms
+static int send_batch(coordinator_t* coordinator, worker_t* worker) {
+    int alive = 0;
+    for (int i = 0; i < coordinator->worker_count; i++) {
+        if (coordinator->workers[i].fd >= 0) alive++;
+    }
+    
+    size_t size = coordinator_remaining(coordinator) / (2 * (size_t)(alive > 0 ? alive : 1));
+    if (size > worker->batch_size) size = worker->batch_size;
+    if (size < 1) size = 1;
+    
+    size_t* batch = realloc(worker->batch, size * sizeof(size_t));
+    unsigned char* payload = malloc(sizeof(uint32_t) + size * sizeof(uint64_t));
+    if (!batch || !payload) {
+        if (batch) worker->batch = batch;
+        free(payload);
+        return -1;
+    }
+    worker->batch = batch;
+    
+    uint32_t count = 0;
+    while (count < size && coordinator_remaining(coordinator) > 0) {
+        size_t index = coordinator_next(coordinator);
+        worker->batch[count] = index;
+        memcpy(payload + sizeof(uint32_t) + count * sizeof(uint64_t),
+               &coordinator->queue.items[index].path_hash, sizeof(uint64_t));
+        count++;
+    }
+    memcpy(payload, &count, sizeof(count));
+    
+    worker->batch_count = count;
+    worker->batch_done = 0;
+    worker->batch_start = monotonic_ns();
+    int status = send_message(worker->fd, MESSAGE_BATCH, payload,
+                              (uint32_t)(sizeof(uint32_t) + count * sizeof(uint64_t)));
+    free(payload);
+    return status;
+}
+
+// results of a retry replace those of the previous attempt
+static void coordinator_case_started(test_case_t* test_case) {
+    if (test_case->attempts++ > 0) reset_case_results(test_case);
+}
+
+static void coordinator_case_done(coordinator_t* coordinator, work_item_t* item) {
+    test_runner_t* runner = coordinator->context->runner;
+    if (case_wants_retry(runner, item->test_case)) {
+        coordinator->reruns[coordinator->rerun_count++] = (size_t)(item - coordinator->queue.items);
+        return;
+    }
+    
+    if (runner->cache && cache_acquire(runner->cache) == 0) {
+        cache_record(runner->cache, item->test_case, item->cache_key);
+        cache_release(runner->cache);
+    }
+    context_case_done(coordinator->context, item->test_case, item->path_hash, item->suite_path);
+}
+
+static int receive_result(coordinator_t* coordinator, worker_t* worker, uint32_t length) {
+    if (length < sizeof(result_message_t) || worker->batch_done >= worker->batch_count) return -1;
+    
+    unsigned char* payload = malloc(length);
+    if (!payload || recv_full(worker->fd, payload, length) != 0) {
+        free(payload);
+        return -1;
+    }
+    
+    result_message_t result;
+    memcpy(&result, payload, sizeof(result));
+    work_item_t* item = &coordinator->queue.items[worker->batch[worker->batch_done]];
+    if (result.path_hash != item->path_hash ||
+        sizeof(result) + (size_t)result.result_count + result.report_length +
+        result.diagnostic_length != length) {
+        free(payload);
+        return -1;
+    }
+    
+    test_case_t* test_case = item->test_case;
+    coordinator_case_started(test_case);
+    test_case->duration_ns += result.duration_ns;
+    for (uint32_t i = 0; i < result.result_count; i++) {
+        test_case_add_result(test_case, (test_status_t)payload[sizeof(result) + i]);
+    }
+    if (result.report_length > 0) {
+        char* report = malloc(result.report_length + 1);
+        if (report) {
+            memcpy(report, payload + sizeof(result) + result.result_count, result.report_length);
+            report[result.report_length] = '\0';
+            free(test_case->report);
+            test_case->report = report;
+        }
+    }
+    
+    // diagnostics arrive without terminators, so each text is copied out first
+    const unsigned char* cursor = payload + sizeof(result) + result.result_count + result.report_length;
+    const unsigned char* end = payload + length;
+    for (uint32_t i = 0; i < result.diagnostic_count; i++) {
+        diagnostic_message_t header;
+        if ((size_t)(end - cursor) < sizeof(header)) break;
+        memcpy(&header, cursor, sizeof(header));
+        cursor += sizeof(header);
         
-        // print results
-        for (int i = 0; i < current_case->result_count; i++) {
-            const char* color = get_status_color(current_case->results[i]);
-            char status_char = get_status_char(current_case->results[i]);
-            printf("%s%c%s ", color, status_char, ANSI_RESET);
+        uint32_t lengths[3] = { header.file_length, header.message_length, header.output_length };
+        char* texts[3] = { NULL, NULL, NULL };
+        bool truncated = false;
+        for (int j = 0; j < 3; j++) {
+            if ((size_t)(end - cursor) < lengths[j]) {
+                truncated = true;
+                break;
+            }
+            if (lengths[j] > 0) texts[j] = strndup((const char*)cursor, lengths[j]);
+            cursor += lengths[j];
         }
-        printf("\n");
+        if (!truncated) {
+            test_diagnostic_t diagnostic = { texts[1], texts[0], header.line, header.signal, texts[2] };
+            test_case_add_diagnostic(test_case, header.result, &diagnostic);
+        }
+        for (int j = 0; j < 3; j++) {
+            free(texts[j]);
+        }
+        if (truncated) break;
+    }
+    free(payload);
+    
+    worker->batch_done++;
+    coordinator_case_done(coordinator, item);
+    return 0;
+}
+
+// the case in flight is blamed, the rest of the batch goes back to the queue
+static void worker_lost(coordinator_t* coordinator, worker_t* worker) {
+    close(worker->fd);
+    worker->fd = -1;
+    
+    int status = 0;
+    waitpid(worker->pid, &status, 0);
+    
+    if (worker->batch_done < worker->batch_count) {
+        work_item_t* item = &coordinator->queue.items[worker->batch[worker->batch_done]];
+        coordinator_case_started(item->test_case);
+        test_case_add_result(item->test_case, STATUS_RUNTIME_ERROR);
+        
+        char message[64];
+        test_diagnostic_t diagnostic = { message, NULL, 0, 0, NULL };
+        if (WIFSIGNALED(status)) {
+            snprintf(message, sizeof(message), "worker killed");
+            diagnostic.signal = WTERMSIG(status);
+        } else {
+            snprintf(message, sizeof(message), "worker exited with status %d",
+                     WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        }
+        test_case_add_diagnostic(item->test_case, item->test_case->result_count - 1, &diagnostic);
+        coordinator_case_done(coordinator, item);
         
-        current_case = current_case->next;
+        for (size_t i = worker->batch_done + 1; i < worker->batch_count; i++) {
+            coordinator->retry[coordinator->retry_count++] = worker->batch[i];
+        }
+    }
+    worker->batch_count = 0;
+    worker->batch_done = 0;
+    
+    if (coordinator_remaining(coordinator) > 0 && coordinator->respawns > 0) {
+        coordinator->respawns--;
+        if (spawn_worker(coordinator, worker) == 0 && send_batch(coordinator, worker) != 0) {
+            worker_lost(coordinator, worker);
+        }
     }
 }
 
-void print_test_results(test_runner_t* runner) {
-    if (!runner || !runner->root_suite) return;
+static void worker_batch_done(coordinator_t* coordinator, worker_t* worker) {
+    uint64_t elapsed = monotonic_ns() - worker->batch_start;
+    size_t size = worker->batch_count;
     
-    print_legend();
+    if (elapsed * 2 < WORKER_TARGET_BATCH_NS) {
+        size = worker->batch_size * 2;
+    } else {
+        size = (size_t)((double)size * WORKER_TARGET_BATCH_NS / (double)elapsed);
+    }
+    if (size < 1) size = 1;
+    if (size > WORKER_MAX_BATCH) size = WORKER_MAX_BATCH;
+    worker->batch_size = size;
+    worker->batch_count = 0;
     
-    // stats calc
-    test_suite_t* current = runner->root_suite;
-    while (current) {
-        calculate_suite_stats(current);
-        current = current->next;
+    if (coordinator_remaining(coordinator) > 0) {
+        if (send_batch(coordinator, worker) != 0) worker_lost(coordinator, worker);
+    } else {
+        send_message(worker->fd, MESSAGE_SHUTDOWN, NULL, 0);
     }
+}
+
+int test_runner_coordinate(test_runner_t* runner, int workers, char* const worker_argv[]) {
+    if (!runner) return -1;
+    if (workers <= 0) workers = runner->jobs;
     
-    current = runner->root_suite;
-    while (current) {
-        bool is_last = (current->next == NULL);
-        print_tree_node(current, "", is_last, 0);
-        current = current->next;
+    // an external worker running the same main() ends up here as well
+    const char* worker_fd = getenv(WORKER_ENV);
+    if (worker_fd && *worker_fd) {
+        serve_worker(runner, atoi(worker_fd));
+        return 0;
+    }
+    
+    run_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.runner = runner;
+    open_cache(runner);
+    
+    coordinator_t coordinator;
+    memset(&coordinator, 0, sizeof(coordinator));
+    coordinator.context = &context;
+    coordinator.worker_argv = worker_argv;
+    coordinator.respawns = workers * 4;
+    int collected = collect_cases(&context, &coordinator.queue);
+    
+    coordinator.retry = malloc((coordinator.queue.count + 1) * sizeof(size_t));
+    coordinator.reruns = malloc((coordinator.queue.count + 1) * sizeof(size_t));
+    coordinator.workers = calloc(workers, sizeof(worker_t));
+    struct pollfd* poll_fds = malloc(workers * sizeof(struct pollfd));
+    if (collected != 0 || !coordinator.retry || !coordinator.reruns || !coordinator.workers || !poll_fds) {
+        free(coordinator.retry);
+        free(coordinator.reruns);
+        free(coordinator.workers);
+        free(poll_fds);
+        free_queue(&coordinator.queue);
+        tap_finish(&context);
+        finish_runner(runner);
+        return -1;
+    }
+    
+    for (int i = 0; i < workers; i++) {
+        worker_t* worker = &coordinator.workers[coordinator.worker_count];
+        worker->fd = -1;
+        if (coordinator_remaining(&coordinator) == 0 || spawn_worker(&coordinator, worker) != 0) break;
+        coordinator.worker_count++;
+        if (send_batch(&coordinator, worker) != 0) worker_lost(&coordinator, worker);
+    }
+    
+    for (;;) {
+        int active = 0;
+        for (int i = 0; i < coordinator.worker_count; i++) {
+            worker_t* worker = &coordinator.workers[i];
+            if (worker->fd < 0 || worker->batch_count == 0) continue;
+            poll_fds[active].fd = worker->fd;
+            poll_fds[active].events = POLLIN;
+            poll_fds[active].revents = 0;
+            active++;
+        }
+        if (active == 0) break;
+        
+        if (poll(poll_fds, active, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        for (int p = 0; p < active; p++) {
+            if (!poll_fds[p].revents) continue;
+            
+            worker_t* worker = NULL;
+            for (int i = 0; i < coordinator.worker_count && !worker; i++) {
+                if (coordinator.workers[i].fd == poll_fds[p].fd) worker = &coordinator.workers[i];
+            }
+            if (!worker) continue;
+            
+            message_header_t header;
+            if (recv_full(worker->fd, &header, sizeof(header)) != 0) {
+                worker_lost(&coordinator, worker);
+            } else if (header.type == MESSAGE_RESULT) {
+                if (receive_result(&coordinator, worker, header.length) != 0) {
+                    worker_lost(&coordinator, worker);
+                }
+            } else if (header.type == MESSAGE_BATCH_DONE) {
+                worker_batch_done(&coordinator, worker);
+            } else {
+                worker_lost(&coordinator, worker);
+            }
+        }
+    }
+    
+    for (int i = 0; i < coordinator.worker_count; i++) {
+        worker_t* worker = &coordinator.workers[i];
+        if (worker->fd >= 0) {
+            close(worker->fd);
+            waitpid(worker->pid, NULL, 0);
+        }
+        free(worker->batch);
+    }
+    
+    // whatever no worker could take is reported as a runtime error, like a
+    // case whose worker was lost; a retry that never ran keeps the failure
+    // it already has
+    while (coordinator_remaining(&coordinator) > 0) {
+        work_item_t* item = &coordinator.queue.items[coordinator_next(&coordinator)];
+        if (item->test_case->attempts == 0) {
+            coordinator_case_started(item->test_case);
+            test_case_add_result(item->test_case, STATUS_RUNTIME_ERROR);
+            test_diagnostic_t diagnostic = { "no worker available", NULL, 0, 0, NULL };
+            test_case_add_diagnostic(item->test_case, item->test_case->result_count - 1, &diagnostic);
+        }
+        context_case_done(&context, item->test_case, item->path_hash, item->suite_path);
     }
+    tap_finish(&context);
+    
+    free(poll_fds);
+    free(coordinator.workers);
+    free(coordinator.retry);
+    free(coordinator.reruns);
+    free_queue(&coordinator.queue);
+    
+    print_test_results(runner);
+    finish_runner(runner);
+    free(context.failed);
+    return 0;
 }
 
 void test_runner_run(test_runner_t* runner) {
     if (!runner) return;
     
-    test_suite_t* current_suite = runner->root_suite;
-    while (current_suite) {
-        test_case_t* current_case = current_suite->test_cases;
-        while (current_case) {
-            if (current_case->test_func && current_case->result_count == 0) {
-                
-                // no manual results were added
-                test_status_t result = current_case->test_func();
-                if (test_case_add_result(current_case, result) != 0) {
-                    fprintf(stderr, "Warning: Failed to add test result for %s\n", 
-                           current_case->name);
+    // started by test_runner_coordinate with an external worker command
+    const char* worker_fd = getenv(WORKER_ENV);
+    if (worker_fd && *worker_fd) {
+        serve_worker(runner, atoi(worker_fd));
+        return;
+    }
+    
+    run_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.runner = runner;
+    
+    execute_runner(&context);
+    print_test_results(runner);
+    finish_runner(runner);
+    free(context.failed);
+}
+
+#ifdef __linux__
+#define WATCH_DEBOUNCE_MS 150
+#define WATCH_STATE_ENV "UNITTEST_WATCH_FD"
+
+typedef struct {
+    int wd;
+    char* name;
+} watch_target_t;
+
+// failing path hashes survive the re-exec in an unlinked temporary file
+static int watch_state_fd(void) {
+    const char* inherited = getenv(WATCH_STATE_ENV);
+    if (inherited && *inherited) {
+        return atoi(inherited);
+    }
+    
+    const char* directory = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/unittest-watch-XXXXXX", directory && *directory ? directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    unlink(path);
+    
+    char value[16];
+    snprintf(value, sizeof(value), "%d", fd);
+    setenv(WATCH_STATE_ENV, value, 1);
+    return fd;
+}
+
+static void watch_load_priority(int fd, run_context_t* context) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(uint64_t)) return;
+    
+    size_t count = (size_t)info.st_size / sizeof(uint64_t);
+    uint64_t* priority = malloc(count * sizeof(uint64_t));
+    if (!priority) return;
+    
+    if (pread(fd, priority, count * sizeof(uint64_t), 0) != (ssize_t)(count * sizeof(uint64_t))) {
+        free(priority);
+        return;
+    }
+    qsort(priority, count, sizeof(uint64_t), compare_hashes);
+    context->priority = priority;
+    context->priority_count = count;
+}
+
+static void watch_store_failed(int fd, const run_context_t* context) {
+    size_t size = context->failed_count * sizeof(uint64_t);
+    if (ftruncate(fd, 0) != 0) return;
+    if (size > 0 && pwrite(fd, context->failed, size, 0) != (ssize_t)size) {
+        fprintf(stderr, "Warning: Failed to save failing tests for the next run\n");
+    }
+}
+
+static int watch_add(int inotify_fd, const char* path, watch_target_t** targets, int* count) {
+    char* copy = strdup(path);
+    if (!copy) return -1;
+    
+    char* slash = strrchr(copy, '/');
+    if (!slash || slash[1] == '\0') {
+        free(copy);
+        return -1;
+    }
+    *slash = '\0';
+    
+    // builds usually replace the file, so watch its directory
+    int wd = inotify_add_watch(inotify_fd, slash == copy ? "/" : copy,
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        free(copy);
+        return -1;
+    }
+    
+    for (int i = 0; i < *count; i++) {
+        if ((*targets)[i].wd == wd && strcmp((*targets)[i].name, slash + 1) == 0) {
+            free(copy);
+            return 0;
+        }
+    }
+    
+    watch_target_t* new_targets = realloc(*targets, (*count + 1) * sizeof(watch_target_t));
+    if (!new_targets) {
+        free(copy);
+        return -1;
+    }
+    *targets = new_targets;
+    
+    // the name is kept inside the duplicated path
+    memmove(copy, slash + 1, strlen(slash + 1) + 1);
+    (*targets)[*count].wd = wd;
+    (*targets)[*count].name = copy;
+    (*count)++;
+    return 0;
+}
+
+static void watch_add_shared_objects(int inotify_fd, watch_target_t** targets, int* count) {
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (!maps) return;
+    
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof(line), maps)) {
+        char* path = strchr(line, '/');
+        if (!path) continue;
+        
+        path[strcspn(path, "\n")] = '\0';
+        if (strstr(path, ".so") && !strstr(path, " (deleted)")) {
+            watch_add(inotify_fd, path, targets, count);
+        }
+    }
+    fclose(maps);
+}
+
+static bool watch_wait_for_change(int inotify_fd, const watch_target_t* targets, int count) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    
+    for (;;) {
+        struct pollfd poll_fd = { inotify_fd, POLLIN, 0 };
+        int ready = poll(&poll_fd, 1, changed ? WATCH_DEBOUNCE_MS : -1);
+        if (ready < 0) return false;
+        
+        // quiet for a moment after a change: the build is done
+        if (ready == 0) return true;
+        
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) return false;
+        
+        for (char* cursor = buffer; cursor < buffer + length;) {
+            const struct inotify_event* event = (const struct inotify_event*)cursor;
+            for (int i = 0; i < count && event->len > 0; i++) {
+                if (targets[i].wd == event->wd && strcmp(targets[i].name, event->name) == 0) {
+                    changed = true;
                 }
             }
-            current_case = current_case->next;
+            cursor += sizeof(struct inotify_event) + event->len;
         }
-        current_suite = current_suite->next;
     }
+}
+#endif
+
+int test_runner_watch(test_runner_t* runner, char* argv[]) {
+    if (!runner || !argv || !argv[0]) return -1;
+
+#ifdef __linux__
+    char executable[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length <= 0) return -1;
+    executable[length] = '\0';
+    
+    int state_fd = watch_state_fd();
+    if (state_fd < 0) return -1;
     
+    run_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.runner = runner;
+    context.progress = true;
+    select_rendering(runner);
+    watch_load_priority(state_fd, &context);
+    
+    execute_runner(&context);
     print_test_results(runner);
-}
\ No newline at end of file
+    finish_runner(runner);
+    fflush(stdout);
+    
+    watch_store_failed(state_fd, &context);
+    free(context.priority);
+    free(context.failed);
+    
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) return -1;
+    
+    watch_target_t* targets = NULL;
+    int count = 0;
+    watch_add(inotify_fd, executable, &targets, &count);
+    watch_add_shared_objects(inotify_fd, &targets, &count);
+    
+    printf("\nWatching for changes...\n");
+    fflush(stdout);
+    
+    // a failed exec usually means the linker is not done yet, keep waiting
+    while (watch_wait_for_change(inotify_fd, targets, count)) {
+        if (access(executable, X_OK) == 0) {
+            printf("\nChange detected, rerunning failed tests first\n\n");
+            fflush(stdout);
+            execv(executable, argv);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        free(targets[i].name);
+    }
+    free(targets);
+    close(inotify_fd);
+    return -1;
+#else
+    fprintf(stderr, "Warning: Watch mode requires inotify\n");
+    return -1;
+#endif
+}
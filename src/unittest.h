@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define ANSI_RESET "\033[0m"
 #define ANSI_GREEN "\033[32m"
@@ -29,34 +30,168 @@ typedef struct {
     int build_error_count;
     int expected_runtime_error_count;
     int runtime_error_count;
+    int flaky_count;
 } test_stats_t;
 
 typedef struct test_case test_case_t;
 typedef struct test_suite test_suite_t;
 typedef struct test_runner test_runner_t;
+typedef struct test_gen test_gen_t;
+typedef struct test_async test_async_t;
 
 typedef test_status_t (*test_func_t)(void);
+typedef test_status_t (*test_param_func_t)(const void* row);
+typedef void (*test_param_name_func_t)(const void* row, int index, char* buffer, size_t size);
+typedef test_status_t (*test_property_func_t)(test_gen_t* gen);
+typedef test_status_t (*test_fuzz_func_t)(const uint8_t* data, size_t size);
+typedef test_status_t (*test_stress_func_t)(int thread);
+typedef void (*test_async_func_t)(test_async_t* async);
+typedef void (*test_async_io_func_t)(test_async_t* async, int fd, int events, void* data);
+
+// tags are bits in a uint64_t mask, so at most this many names exist
+#define TEST_MAX_TAGS 64
+
+// events for test_async_watch and its callbacks, errors are always reported
+#define TEST_ASYNC_READ 0x1
+#define TEST_ASYNC_WRITE 0x2
+#define TEST_ASYNC_ERROR 0x4
+typedef int (*test_register_func_t)(test_runner_t* runner);
+
+// optional details of one failing result, all fields may be NULL or 0
+typedef struct {
+    const char* message;
+    const char* file;
+    int line;
+    int signal;
+    const char* output;     // captured stdout/stderr
+} test_diagnostic_t;
+
+// the runner's result store as columns, valid until the runner records or
+// prints results again
+typedef struct {
+    const uint8_t* statuses;        // one per result, above STATUS_RUNTIME_ERROR if out of range
+    size_t result_count;
+    test_case_t* const* cases;      // by case id, a case's results are its store span
+    const uint64_t* durations;      // by case id, duration_ns as last stored
+    size_t case_count;
+} test_result_columns_t;
+
+typedef enum {
+    TEST_KIND_SIMPLE,
+    TEST_KIND_PARAM,
+    TEST_KIND_PROPERTY,
+    TEST_KIND_FUZZ,
+    TEST_KIND_STRESS,
+    TEST_KIND_ASYNC
+} test_case_kind_t;
 
 struct test_case {
-    char* name;
+    const char* name;       // interned, shared by every case of that name
     test_func_t test_func;
+    test_case_kind_t kind;
     test_status_t* results;
     int result_count;
     int result_capacity;
     test_case_t* next;
+
+    // parameterized cases: rows are borrowed, one result per row
+    test_param_func_t param_func;
+    test_param_name_func_t param_name;
+    const void* params;
+    size_t param_size;
+    int param_count;
+
+    // property cases: one result per run
+    test_property_func_t property_func;
+    int property_iterations;
+
+    // fuzz targets: one result per corpus input
+    test_fuzz_func_t fuzz_func;
+    char* fuzz_corpus;
+
+    // stress cases: one result per thread, a duration overrides the iterations
+    test_stress_func_t stress_func;
+    int stress_threads;
+    uint64_t stress_iterations;
+    uint64_t stress_duration_ns;
+
+    // async cases: started, then completed from event callbacks or timed out
+    test_async_func_t async_func;
+    uint64_t async_timeout_ns;
+
+    // result cache key, 0 falls back to a hash of the test binary
+    uint64_t version;
+
+    // wall time spent executing the case, summed over runs and shards
+    uint64_t duration_ns;
+
+    // extra line printed under the case, e.g. a shrunk counterexample
+    char* report;
+
+    // retries: attempts in the current run, runs recorded (including loaded
+    // logs) and how many of those only passed on a retry
+    int attempts;
+    int run_count;
+    int flaky_count;
+
+    // spinlock taken by test_case_add_result, results may come from any thread
+    int result_lock;
+
+    // details of failing results, NULL until the first one is recorded
+    struct test_diagnostics* diagnostics;
+
+    // own tags, see test_tag_register; filtered is set by the runner when
+    // the case does not match its tag filter and is skipped
+    uint64_t tags;
+    bool filtered;
+
+    // position in DFS order, set when a streaming reporter starts a run
+    uint32_t run_index;
+
+    // span of the results in the runner's result store, stored when the case
+    // is done or printed; store_id is the case id + 1, 0 until then
+    size_t store_id;
+    size_t store_offset;
+    int store_count;
 };
 
 struct test_suite {
-    char* name;
+    const char* name;       // interned like case names
     test_case_t* test_cases;
     test_suite_t* child_suites;
     test_suite_t* next;
     test_stats_t stats;
+    test_case_t* last_test_case;
+    test_suite_t* last_child;
+    uint64_t tags;      // inherited by every case below
 };
 
 struct test_runner {
     test_suite_t* root_suite;
+    test_suite_t* last_suite;
     test_stats_t global_stats;
+    uint64_t seed;
+    int jobs;
+    int retries;
+    bool verbose;
+    bool color;         // ANSI colors, detected from the terminal
+    int run_length;     // runs of this many equal results print as "K×4096", 0 for never
+    int max_depth;      // suite levels printed, 0 prints all of them
+    bool failures_only; // print only failing cases and the suites above them
+    bool collapse;      // print suites without failures as one line
+    bool capture;
+    bool timing;        // per-case durations, off saves the clock reads
+    int shard_index;    // runs the cases whose path hash % shard_count == shard_index
+    int shard_count;
+    char* filter;       // tag expression, parsed when a run starts
+    struct path_index* index;   // built by the first lookup, see test_runner_find_case
+    struct result_store* store; // result columns, see test_runner_result_columns
+    char* cache_path;
+    struct result_cache* cache;
+    char* log_path;
+    char* tap_path;
+    void** modules;
+    int module_count;
 };
 
 test_runner_t* test_runner_create(void);
@@ -73,16 +208,89 @@ void test_case_destroy(test_case_t* test_case);
 void test_case_destroy_siblings(test_case_t* test_case);
 int test_case_add_result(test_case_t* test_case, test_status_t status);
 int test_case_add_results_va(test_case_t* test_case, int count, ...);
+void test_case_set_version(test_case_t* test_case, const char* version);
+int test_case_add_diagnostic(test_case_t* test_case, int result, const test_diagnostic_t* diagnostic);
+int test_case_diagnostic(test_case_t* test_case, int result, test_diagnostic_t* diagnostic);
+
+int test_tag_register(const char* name);
+int test_case_add_tag(test_case_t* test_case, const char* tag);
+int test_suite_add_tag(test_suite_t* suite, const char* tag);
+
+test_case_t* test_case_create_param(const char* name, test_param_func_t param_func,
+                                    const void* params, size_t param_size, int param_count);
+void test_case_set_param_name(test_case_t* test_case, test_param_name_func_t param_name);
+const void* test_case_param_row(const test_case_t* test_case, int index);
+
+test_case_t* test_case_create_property(const char* name, test_property_func_t property_func,
+                                       int iterations);
+
+int64_t test_gen_int(test_gen_t* gen, int64_t min, int64_t max);
+bool test_gen_bool(test_gen_t* gen);
+size_t test_gen_size(test_gen_t* gen, size_t max);
+size_t test_gen_bytes(test_gen_t* gen, uint8_t* buffer, size_t max_size);
+size_t test_gen_string(test_gen_t* gen, char* buffer, size_t buffer_size);
+size_t test_gen_ints(test_gen_t* gen, int64_t* values, size_t max_count, int64_t min, int64_t max);
+
+test_case_t* test_case_create_fuzz(const char* name, test_fuzz_func_t fuzz_func,
+                                   const char* corpus_dir);
+int test_fuzz_run_one(test_fuzz_func_t fuzz_func, const uint8_t* data, size_t size);
+
+test_case_t* test_case_create_stress(const char* name, test_stress_func_t stress_func,
+                                     int threads, uint64_t iterations);
+void test_case_set_stress_duration(test_case_t* test_case, uint64_t duration_ms);
+
+test_case_t* test_case_create_async(const char* name, test_async_func_t async_func, uint64_t timeout_ms);
+int test_async_watch(test_async_t* async, int fd, int events, test_async_io_func_t callback, void* data);
+void test_async_unwatch(test_async_t* async, int fd);
+void test_async_set_data(test_async_t* async, void* data, void (*cleanup)(void* data));
+void* test_async_data(const test_async_t* async);
+void test_async_done(test_async_t* async, test_status_t status);
 
 void test_runner_add_suite(test_runner_t* runner, test_suite_t* suite);
+test_suite_t* test_runner_find_suite(test_runner_t* runner, const char* path);
+test_case_t* test_runner_find_case(test_runner_t* runner, const char* path);
+void test_runner_set_seed(test_runner_t* runner, uint64_t seed);
+void test_runner_set_jobs(test_runner_t* runner, int jobs);
+void test_runner_set_retries(test_runner_t* runner, int retries);
+void test_runner_set_verbose(test_runner_t* runner, bool verbose);
+void test_runner_set_color(test_runner_t* runner, bool color);
+void test_runner_set_run_length(test_runner_t* runner, int threshold);
+void test_runner_set_max_depth(test_runner_t* runner, int depth);
+void test_runner_set_failures_only(test_runner_t* runner, bool failures_only);
+void test_runner_set_collapse(test_runner_t* runner, bool collapse);
+void test_runner_set_capture(test_runner_t* runner, bool capture);
+void test_runner_set_timing(test_runner_t* runner, bool timing);
+int test_runner_set_shard(test_runner_t* runner, int index, int count);
+int test_runner_set_filter(test_runner_t* runner, const char* expression);
+int test_runner_set_cache(test_runner_t* runner, const char* path);
+int test_runner_set_log(test_runner_t* runner, const char* path);
+int test_runner_set_tap(test_runner_t* runner, const char* path);
+int test_runner_write_log(test_runner_t* runner, const char* path);
+int test_runner_load_log(test_runner_t* runner, const char* path);
+int test_runner_load_dir(test_runner_t* runner, const char* directory);
+int test_runner_result_columns(test_runner_t* runner, test_result_columns_t* columns);
 void test_runner_run(test_runner_t* runner);
+int test_runner_watch(test_runner_t* runner, char* argv[]);
+int test_runner_coordinate(test_runner_t* runner, int workers, char* const worker_argv[]);
+
+void test_assert_failed(const char* file, int line, const char* expression);
+void test_assert_failed_int(const char* file, int line, const char* expression,
+                            uint64_t left, uint64_t right, int flags);
+void test_assert_failed_str(const char* file, int line, const char* expression,
+                            const char* left, const char* right);
+void test_assert_failed_mem(const char* file, int line, const char* expression,
+                            const void* left, const void* right, size_t size);
 
 void print_legend(void);
 void print_test_results(test_runner_t* runner);
+int print_test_diff(test_runner_t* before, test_runner_t* after, double threshold);
 
 #define UNITTEST_SUITE(name) test_suite_create(name)
 #define UNITTEST_CASE(name, func) test_case_create(name, func)
 #define UNITTEST_RUN(runner) test_runner_run(runner)
+#define UNITTEST_PROPERTY(name, func) test_case_create_property(name, func, 0)
+#define UNITTEST_PARAM_CASE(name, func, rows) test_case_create_param(name, func, \
+    rows, sizeof((rows)[0]), (int)(sizeof(rows)/sizeof((rows)[0])))
 
 #define RESULTS(test_case, ...) test_case_add_results_va(test_case, \
     sizeof((test_status_t[]){__VA_ARGS__})/sizeof(test_status_t), __VA_ARGS__)
@@ -90,4 +298,126 @@ void print_test_results(test_runner_t* runner);
 #define RESULTS_ARRAY(...) (test_status_t[]){__VA_ARGS__}, \
     sizeof((test_status_t[]){__VA_ARGS__})/sizeof(test_status_t)
 
+// assertions for test functions returning test_status_t: a passing check is
+// a single compare, a failing one records its operands and returns
+// STATUS_RUNTIME_ERROR; the message is only formatted when printed
+#ifdef __GNUC__
+#define UNITTEST_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define UNITTEST_UNLIKELY(x) (x)
+#endif
+
+#define TEST_ASSERT_LEFT_SIGNED 0x1
+#define TEST_ASSERT_RIGHT_SIGNED 0x2
+#define ASSERT_OPERAND_LIMIT 16
+
+// signedness of an operand's type, and whether it is floating-point: the
+// comparisons are for integers and pointers, a float fails to compile where
+// the compiler can tell
+#ifdef __GNUC__
+#define UNITTEST_IS_SIGNED(x) ((__typeof__(x))-1 < (__typeof__(x))1)
+#define UNITTEST_IS_FLOAT(x) (__builtin_types_compatible_p(__typeof__(x), float) || \
+    __builtin_types_compatible_p(__typeof__(x), double) || \
+    __builtin_types_compatible_p(__typeof__(x), long double))
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define UNITTEST_IS_SIGNED(x) _Generic((x), char: (char)-1 < 0, signed char: 1, short: 1, int: 1, \
+    long: 1, long long: 1, default: 0)
+#define UNITTEST_IS_FLOAT(x) _Generic((x), float: 1, double: 1, long double: 1, default: 0)
+#else
+// integers only: the conditional has x's promoted type and never evaluates x
+#define UNITTEST_IS_SIGNED(x) ((0 ? (x) : 0) - 1 < 1)
+#define UNITTEST_IS_FLOAT(x) 0
+#endif
+#define UNITTEST_REQUIRE_INTEGER(x) ((void)sizeof(char[UNITTEST_IS_FLOAT(x) ? -1 : 1]))
+
+#define ASSERT_TRUE(cond) do { \
+        if (UNITTEST_UNLIKELY(!(cond))) { \
+            test_assert_failed(__FILE__, __LINE__, "ASSERT_TRUE(" #cond ")"); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+#define ASSERT_FALSE(cond) do { \
+        if (UNITTEST_UNLIKELY(cond)) { \
+            test_assert_failed(__FILE__, __LINE__, "ASSERT_FALSE(" #cond ")"); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+
+#ifdef __GNUC__
+#define UNITTEST_ASSERT_CMP(name, op, a, b) do { \
+        UNITTEST_REQUIRE_INTEGER(a); \
+        UNITTEST_REQUIRE_INTEGER(b); \
+        __typeof__(a) unittest_left_ = (a); \
+        __typeof__(b) unittest_right_ = (b); \
+        if (UNITTEST_UNLIKELY(!(unittest_left_ op unittest_right_))) { \
+            test_assert_failed_int(__FILE__, __LINE__, name "(" #a ", " #b ")", \
+                (uint64_t)unittest_left_, (uint64_t)unittest_right_, \
+                (UNITTEST_IS_SIGNED(unittest_left_) ? TEST_ASSERT_LEFT_SIGNED : 0) | \
+                (UNITTEST_IS_SIGNED(unittest_right_) ? TEST_ASSERT_RIGHT_SIGNED : 0)); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+#else
+// without __typeof__ the operands cannot be copied, so a failing assertion
+// evaluates them a second time to record them
+#define UNITTEST_ASSERT_CMP(name, op, a, b) do { \
+        UNITTEST_REQUIRE_INTEGER(a); \
+        UNITTEST_REQUIRE_INTEGER(b); \
+        if (UNITTEST_UNLIKELY(!((a) op (b)))) { \
+            test_assert_failed_int(__FILE__, __LINE__, name "(" #a ", " #b ")", \
+                (uint64_t)(a), (uint64_t)(b), \
+                (UNITTEST_IS_SIGNED(a) ? TEST_ASSERT_LEFT_SIGNED : 0) | \
+                (UNITTEST_IS_SIGNED(b) ? TEST_ASSERT_RIGHT_SIGNED : 0)); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+#endif
+
+#define ASSERT_EQ(a, b) UNITTEST_ASSERT_CMP("ASSERT_EQ", ==, a, b)
+#define ASSERT_NE(a, b) UNITTEST_ASSERT_CMP("ASSERT_NE", !=, a, b)
+#define ASSERT_LT(a, b) UNITTEST_ASSERT_CMP("ASSERT_LT", <, a, b)
+#define ASSERT_LE(a, b) UNITTEST_ASSERT_CMP("ASSERT_LE", <=, a, b)
+#define ASSERT_GT(a, b) UNITTEST_ASSERT_CMP("ASSERT_GT", >, a, b)
+#define ASSERT_GE(a, b) UNITTEST_ASSERT_CMP("ASSERT_GE", >=, a, b)
+
+#define ASSERT_STR_EQ(a, b) do { \
+        const char* unittest_left_ = (a); \
+        const char* unittest_right_ = (b); \
+        if (UNITTEST_UNLIKELY(unittest_left_ != unittest_right_ && \
+                (!unittest_left_ || !unittest_right_ || strcmp(unittest_left_, unittest_right_) != 0))) { \
+            test_assert_failed_str(__FILE__, __LINE__, "ASSERT_STR_EQ(" #a ", " #b ")", \
+                unittest_left_, unittest_right_); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+
+#define ASSERT_MEM_EQ(a, b, size) do { \
+        const void* unittest_left_ = (a); \
+        const void* unittest_right_ = (b); \
+        size_t unittest_size_ = (size); \
+        if (UNITTEST_UNLIKELY(memcmp(unittest_left_, unittest_right_, unittest_size_) != 0)) { \
+            test_assert_failed_mem(__FILE__, __LINE__, "ASSERT_MEM_EQ(" #a ", " #b ", " #size ")", \
+                unittest_left_, unittest_right_, unittest_size_); \
+            return STATUS_RUNTIME_ERROR; \
+        } \
+    } while (0)
+
+// entry point looked up by test_runner_load_dir in every shared object
+#define UNITTEST_REGISTER_SYMBOL "unittest_register"
+#define UNITTEST_REGISTER(runner) \
+    int unittest_register(test_runner_t* runner); \
+    int unittest_register(test_runner_t* runner)
+
+// builds with -DUNITTEST_LIBFUZZER export the target for -fsanitize=fuzzer;
+// the test binary's own main() must be compiled out in that configuration
+#ifdef UNITTEST_LIBFUZZER
+#define UNITTEST_FUZZ_TARGET(func) \
+    int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size); \
+    int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) { \
+        return test_fuzz_run_one(func, data, size); \
+    }
+#else
+#define UNITTEST_FUZZ_TARGET(func)
+#endif
+
 #endif // UNITTEST_H
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "unittest.h"
+
+#define DEFAULT_THRESHOLD 0.2 // timing changes smaller than 20% are noise
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s print [-v] LOG...\n", program);
+    fprintf(stderr, "       %s merge OUTPUT LOG...\n", program);
+    fprintf(stderr, "       %s diff [-t PERCENT] BEFORE AFTER\n", program);
+}
+
+// merges every log into one runner, shards of the same tree end up combined
+static test_runner_t* load_logs(int count, char* paths[]) {
+    test_runner_t* runner = test_runner_create();
+    if (!runner) {
+        fprintf(stderr, "Failed to create test runner\n");
+        return NULL;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (test_runner_load_log(runner, paths[i]) != 0) {
+            fprintf(stderr, "Failed to load result log %s\n", paths[i]);
+            test_runner_destroy(runner);
+            return NULL;
+        }
+    }
+    return runner;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "print") == 0) {
+        // -v shows every recorded failure, not just the first of each case
+        bool verbose = strcmp(argv[2], "-v") == 0;
+        int first = verbose ? 3 : 2;
+        if (argc - first < 1) {
+            usage(argv[0]);
+            return 2;
+        }
+        
+        test_runner_t* runner = load_logs(argc - first, argv + first);
+        if (!runner) return 1;
+        
+        if (verbose) test_runner_set_verbose(runner, true);
+        print_test_results(runner);
+        test_runner_destroy(runner);
+        return 0;
+    }
+    
+    if (argc >= 4 && strcmp(argv[1], "merge") == 0) {
+        test_runner_t* runner = load_logs(argc - 3, argv + 3);
+        if (!runner) return 1;
+        
+        int status = test_runner_write_log(runner, argv[2]);
+        if (status != 0) {
+            fprintf(stderr, "Failed to write result log %s\n", argv[2]);
+        }
+        test_runner_destroy(runner);
+        return status != 0;
+    }
+    
+    if (argc >= 4 && strcmp(argv[1], "diff") == 0) {
+        double threshold = DEFAULT_THRESHOLD;
+        int first = 2;
+        if (strcmp(argv[2], "-t") == 0) {
+            char* end;
+            threshold = strtod(argv[3], &end) / 100.0;
+            if (*end != '\0' || threshold < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            first = 4;
+        }
+        if (argc - first != 2) {
+            usage(argv[0]);
+            return 2;
+        }
+        
+        test_runner_t* before = load_logs(1, argv + first);
+        if (!before) return 2;
+        test_runner_t* after = load_logs(1, argv + first + 1);
+        if (!after) {
+            test_runner_destroy(before);
+            return 2;
+        }
+        
+        // like diff(1): 0 when nothing changed, 1 when something did
+        int changes = print_test_diff(before, after, threshold);
+        if (changes < 0) {
+            fprintf(stderr, "Failed to compare result logs\n");
+        }
+        test_runner_destroy(before);
+        test_runner_destroy(after);
+        return changes < 0 ? 2 : changes > 0;
+    }
+    
+    usage(argv[0]);
+    return 2;
+}